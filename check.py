@@ -0,0 +1,18 @@
+import sys
+puz=[l.strip() for l in open(sys.argv[1])]
+ans=[l.rstrip('\n') for l in open(sys.argv[2])]
+print(len(puz),len(ans))
+for i,(p,a) in enumerate(zip(puz,ans)):
+    p=p.replace('.','0')
+    if len(a)!=81: print(i,'noans',repr(a)); continue
+    ok=all(pc=='0' or pc==ac for pc,ac in zip(p,a))
+    full='0' not in a
+    def valid(a):
+        g=[[a[r*9+c] for c in range(9)] for r in range(9)]
+        for k in range(9):
+            if len(set(g[k]))!=9: return False
+            if len(set(g[r][k] for r in range(9)))!=9: return False
+            b=[g[3*(k//3)+i][3*(k%3)+j] for i in range(3) for j in range(3)]
+            if len(set(b))!=9: return False
+        return True
+    print(i, 'givens_ok' if ok else 'GIVENS_BAD', 'full' if full else 'partial', ('valid' if full and valid(a) else ('INVALID' if full else '')))
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HAS_RDTSC 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#else
+#define HAS_RDTSC 0
+#endif
+
+const char* DISTRIBUTION_TEXT[DISTRIBUTION_COUNT] = {"random", "sparse", "dense", "bitmap"};
+
+static volatile uint64_t sink = 0;
+
+CycleCounter::CycleCounter():
+		descriptor(-1)
+{
+#if defined(__linux__)
+	perf_event_attr attribute;
+	std::memset(&attribute, 0, sizeof(attribute));
+	attribute.type = PERF_TYPE_HARDWARE;
+	attribute.size = sizeof(attribute);
+	attribute.config = PERF_COUNT_HW_CPU_CYCLES;
+	attribute.exclude_kernel = 1;
+	attribute.exclude_hv = 1;
+	descriptor = static_cast<int>(syscall(__NR_perf_event_open, &attribute, 0, -1, -1, 0));
+#endif
+}
+
+CycleCounter::~CycleCounter()
+{
+#if defined(__linux__)
+	if(descriptor >= 0)
+		close(descriptor);
+#endif
+}
+
+uint64_t CycleCounter::now() const
+{
+#if defined(__linux__)
+	uint64_t value;
+	if(descriptor >= 0 && read(descriptor, &value, sizeof(value)) == sizeof(value))
+		return value;
+#endif
+
+#if HAS_RDTSC
+	return __rdtsc();
+#else
+	auto time = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+#endif
+}
+
+const char* CycleCounter::unit() const
+{
+	if(descriptor >= 0)
+		return "cycles";
+	return HAS_RDTSC? "ref-cycles": "ns";
+}
+
+/*
+ * SplitMix64, it's small and good enough to make test bits.
+ * @see http://prng.di.unimi.it/splitmix64.c
+ */
+static uint64_t next_random(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+void fill_input(void* buffer, size_t size, Distribution distribution, uint64_t seed)
+{
+	uint64_t state = seed;
+	uint8_t* bytes = static_cast<uint8_t*>(buffer);
+	bool bit = false;
+	uint32_t run = 0;  // bits left in the current run of bitmap.
+	for(size_t i = 0; i < size; i += sizeof(uint64_t))
+	{
+		uint64_t word = 0;
+		switch(distribution)
+		{
+		case DISTRIBUTION_RANDOM:
+			word = next_random(state);
+			break;
+		case DISTRIBUTION_SPARSE:
+		case DISTRIBUTION_DENSE:
+			// AND of five random words sets a bit with probability 1/32.
+			word = ~0ULL;
+			for(int k = 0; k < 5; ++k)
+				word &= next_random(state);
+			if(distribution == DISTRIBUTION_DENSE)
+				word = ~word;
+			break;
+		case DISTRIBUTION_BITMAP:
+			for(int k = 0; k < 64; ++k, --run)
+			{
+				if(run == 0)
+				{
+					bit = !bit;
+					run = 1 + next_random(state) % 128;
+				}
+				word |= static_cast<uint64_t>(bit) << k;
+			}
+			break;
+		default:
+			break;
+		}
+
+		std::memcpy(bytes + i, &word, std::min(sizeof(word), size - i));
+	}
+}
+
+/*
+ * Bytes of the cache at @p level, or a typical size if the system can't tell.
+ */
+static size_t cache_size(int level)
+{
+	long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+	size = sysconf(level == 1? _SC_LEVEL1_DCACHE_SIZE: _SC_LEVEL2_CACHE_SIZE);
+#endif
+	if(size > 0)
+		return static_cast<size_t>(size);
+	return level == 1? size_t(32) << 10: size_t(1) << 20;
+}
+
+CacheEvictor::CacheEvictor(int level):
+		lines(2 * cache_size(level), 0),
+		value(0)
+{
+}
+
+size_t CacheEvictor::size() const
+{
+	return lines.size();
+}
+
+void CacheEvictor::evict()
+{
+	// writes rather than reads, so the lines are owned and the old ones must leave.
+	++value;
+	for(size_t i = 0; i < lines.size(); i += 64)
+		lines[i] = value;
+	consume(lines[lines.size() / 2]);
+}
+
+Summary summarize(std::vector<double> samples)
+{
+	Summary summary = {0.0, 0.0, 0.0};
+	const size_t n = samples.size();
+	if(n == 0)
+		return summary;
+
+	std::sort(samples.begin(), samples.end());
+	summary.median = n % 2 != 0? samples[n / 2]: (samples[n / 2 - 1] + samples[n / 2]) / 2;
+
+	// The rank of the median within samples is binomial(n, 1/2), take ranks n/2 -+ 1.96 sigma.
+	const double half = 1.96 * std::sqrt(static_cast<double>(n)) / 2;
+	const double low = std::floor(n / 2.0 - half), high = std::ceil(n / 2.0 + half);
+	summary.low = samples[static_cast<size_t>(std::max(0.0, low))];
+	summary.high = samples[static_cast<size_t>(std::min(n - 1.0, high))];
+	return summary;
+}
+
+void consume(uint64_t result)
+{
+	sink = sink + result;
+}
+
+Table::Table(const std::vector<std::string>& header)
+{
+	rows.push_back(header);
+}
+
+void Table::add_row(const std::vector<std::string>& row)
+{
+	rows.push_back(row);
+}
+
+void Table::print() const
+{
+	std::vector<size_t> widths;
+	for(const std::vector<std::string>& row: rows)
+	{
+		widths.resize(std::max(widths.size(), row.size()), 0);
+		for(size_t i = 0; i < row.size(); ++i)
+			widths[i] = std::max(widths[i], row[i].size());
+	}
+
+	for(size_t r = 0; r < rows.size(); ++r)
+	{
+		const std::vector<std::string>& row = rows[r];
+		for(size_t i = 0; i < row.size(); ++i)  // the first column is left aligned, others right.
+			printf(i == 0? "%-*s": "  %*s", static_cast<int>(widths[i]), row[i].c_str());
+		printf("\n");
+
+		if(r == 0)
+		{
+			size_t width = 0;
+			for(const size_t& w: widths)
+				width += w + 2;
+			printf("%s\n", std::string(width - 2, '-').c_str());
+		}
+	}
+}
+
+std::string Table::format(const Summary& summary)
+{
+	char text[64];
+	snprintf(text, sizeof(text), "%.2f [%.2f, %.2f]", summary.median, summary.low, summary.high);
+	return text;
+}
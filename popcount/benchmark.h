@@ -0,0 +1,133 @@
+#ifndef GITHUB_KALO2_POPCOUNT_BENCHMARK_
+#define GITHUB_KALO2_POPCOUNT_BENCHMARK_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Count CPU cycles of the calling thread.
+ *
+ * On Linux it reads the core cycle counter through perf_event, which follows frequency scaling. If
+ * perf_event isn't permitted, it falls back to the time stamp counter (rdtsc), which ticks at a
+ * constant reference rate. On other platforms it counts nanoseconds.
+ */
+class CycleCounter
+{
+private:
+	int descriptor;  // perf_event file descriptor, negative if unavailable.
+
+public:
+	CycleCounter();
+	~CycleCounter();
+
+	CycleCounter(const CycleCounter&) = delete;
+	CycleCounter& operator=(const CycleCounter&) = delete;
+
+	uint64_t now() const;
+
+	/**
+	 * @return "cycles", "ref-cycles" or "ns".
+	 */
+	const char* unit() const;
+};
+
+/**
+ * Bit patterns of benchmark input, a branchy method may be fast on one and slow on another.
+ */
+enum Distribution
+{
+	DISTRIBUTION_RANDOM,  ///< each bit is set with probability 1/2.
+	DISTRIBUTION_SPARSE,  ///< each bit is set with probability 1/32.
+	DISTRIBUTION_DENSE,   ///< each bit is set with probability 31/32.
+	DISTRIBUTION_BITMAP,  ///< runs of set and clear bits, like a bitmap index or a bloom filter.
+
+	DISTRIBUTION_COUNT,
+};
+
+extern const char* DISTRIBUTION_TEXT[DISTRIBUTION_COUNT];
+
+/**
+ * Fill @p size bytes at @p buffer with random bits of @p distribution, the same @p seed gives the
+ * same bits.
+ */
+void fill_input(void* buffer, size_t size, Distribution distribution, uint64_t seed);
+
+/**
+ * Median of samples and its 95% confidence interval, which comes from order statistics, so no
+ * normal distribution is assumed.
+ */
+struct Summary
+{
+	double median;
+	double low;
+	double high;
+};
+
+Summary summarize(std::vector<double> samples);
+
+/**
+ * Run @p trial (warmup + trials) times, it returns the measurement of one trial.
+ * @return measurements of the trials after warmup.
+ */
+template <typename Trial>
+std::vector<double> run_trials(Trial trial, int warmup, int trials)
+{
+	for(int i = 0; i < warmup; ++i)
+		trial();
+
+	std::vector<double> samples;
+	samples.reserve(trials);
+	for(int i = 0; i < trials; ++i)
+		samples.push_back(trial());
+	return samples;
+}
+
+/**
+ * Results are added to a volatile sink, so the compiler can't delete the computation.
+ */
+void consume(uint64_t result);
+
+/**
+ * The other work of a loaded server, which shares the core and evicts the caches between calls of
+ * the method. evict() writes a line of every 64 bytes of a buffer twice the size of the cache, so
+ * whatever was cached before is gone.
+ */
+class CacheEvictor
+{
+private:
+	std::vector<uint8_t> lines;
+	uint8_t value;
+
+public:
+	/**
+	 * @param level 1 for the L1 data cache, 2 for L2.
+	 */
+	explicit CacheEvictor(int level);
+
+	size_t size() const;
+	void evict();
+};
+
+/**
+ * A text table, columns are aligned when it's printed.
+ */
+class Table
+{
+private:
+	std::vector<std::vector<std::string>> rows;  // the first row is the header.
+
+public:
+	explicit Table(const std::vector<std::string>& header);
+
+	void add_row(const std::vector<std::string>& row);
+	void print() const;
+
+	/**
+	 * @return text like "1.23 [1.20, 1.25]".
+	 */
+	static std::string format(const Summary& summary);
+};
+
+#endif  // GITHUB_KALO2_POPCOUNT_BENCHMARK_
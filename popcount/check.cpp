@@ -0,0 +1,484 @@
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "benchmark.h"
+#include "check.h"
+#include "cpu_features.h"
+#include "methods.h"
+#include "popcount.h"
+#include "popcount_constexpr.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#else
+#define HAS_MMAP 0
+#endif
+
+/*
+ * Checks and failures of one part of the cross-check, it's shared by the threads.
+ */
+class Report
+{
+private:
+	static constexpr uint64_t PRINTED = 10;  // failures printed, the rest are only counted.
+
+	std::mutex mutex;
+	const char* part;
+	uint64_t checks;
+	uint64_t failures;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	explicit Report(const char* part):
+			part(part),
+			checks(0),
+			failures(0),
+			start(std::chrono::steady_clock::now())
+	{
+	}
+
+	void pass(uint64_t count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		checks += count;
+	}
+
+	void fail(const char* format, ...)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++checks;
+		if(++failures > PRINTED)
+			return;
+		
+		va_list arguments;
+		va_start(arguments, format);
+		fprintf(stderr, "%s: ", part);
+		vfprintf(stderr, format, arguments);
+		fprintf(stderr, "\n");
+		va_end(arguments);
+	}
+
+	/**
+	 * Print the summary of the part.
+	 * @return true if nothing failed.
+	 */
+	bool finish()
+	{
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%-28s %14llu checks, %llu failures, %.1f s\n", part, static_cast<unsigned long long>(checks),
+				static_cast<unsigned long long>(failures), seconds);
+		return failures == 0;
+	}
+};
+
+/*
+ * Bytes between two inaccessible pages, so a kernel that reads past either end of its input
+ * faults instead of passing by chance. Without mmap it's plain memory, and only the results are
+ * checked.
+ */
+class GuardedBuffer
+{
+private:
+	uint8_t* region;
+	size_t regionSize;
+	uint8_t* bytes;
+	size_t length;
+
+public:
+	explicit GuardedBuffer(size_t size) noexcept(false)
+	{
+#if HAS_MMAP
+		const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		length = (size + page - 1) / page * page;
+		regionSize = length + 2 * page;
+		void* address = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(address == MAP_FAILED)
+			throw std::bad_alloc();
+		region = static_cast<uint8_t*>(address);
+		bytes = region + page;
+		mprotect(region, page, PROT_NONE);
+		mprotect(bytes + length, page, PROT_NONE);
+#else
+		length = size;
+		regionSize = size;
+		region = new uint8_t[size];
+		bytes = region;
+#endif
+	}
+
+	~GuardedBuffer()
+	{
+#if HAS_MMAP
+		munmap(region, regionSize);
+#else
+		delete[] region;
+#endif
+	}
+
+	GuardedBuffer(const GuardedBuffer&) = delete;
+	GuardedBuffer& operator=(const GuardedBuffer&) = delete;
+
+	uint8_t* begin() { return bytes; }
+	uint8_t* end() { return bytes + length; }
+	size_t size() const { return length; }
+};
+
+/*
+ * The reference, bit by bit, it shares no code with the methods.
+ */
+template <typename T>
+static int reference_popcount(T n)
+{
+	int count = 0;
+	for(; n != 0; n >>= 1)
+		count += static_cast<int>(n & 1);
+	return count;
+}
+
+static uint64_t split_mix(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+template <typename Method>
+static bool available(const Method& method)
+{
+	if(method.supported())
+		return true;
+	printf("%s is skipped, the CPU doesn't support it.\n", method.name);
+	return false;
+}
+
+/*
+ * Every scalar method over all 2^32 integers, the threads take chunks of 2^16 in turn.
+ */
+static bool check_scalar(ThreadPool& pool)
+{
+	std::vector<const Method<FUNC_POPCNT>*> methods;
+	for(const Method<FUNC_POPCNT>& method: SCALAR_METHOD)
+		if(available(method))
+			methods.push_back(&method);
+	
+	Report report("scalar, 32-bit space");
+	constexpr int CHUNK_BITS = 16;
+	pool.run(size_t(1) << (32 - CHUNK_BITS), [&](size_t chunk, unsigned)
+	{
+		uint32_t n = static_cast<uint32_t>(chunk << CHUNK_BITS);
+		int expected = reference_popcount(n);
+		for(uint32_t i = 0; i < (1U << CHUNK_BITS); ++i, ++n)
+		{
+			for(const Method<FUNC_POPCNT>* method: methods)
+			{
+				const int result = method->pfunc(n);
+				if(result != expected)
+					report.fail("%s(0x%08x) = %d, expected %d", method->name, n, result, expected);
+			}
+			
+			// n + 1 clears the trailing ones of n and sets the bit above them.
+			int trailing = 0;
+			for(uint32_t m = n; (m & 1) != 0; m >>= 1)
+				++trailing;
+			expected += 1 - trailing;
+		}
+		report.pass(methods.size() << CHUNK_BITS);
+	});
+	return report.finish();
+}
+
+/*
+ * Edge patterns, which break carries and modular tricks, then random values of each density.
+ */
+static std::vector<uint64_t> make_values(size_t randomCount, uint64_t seed)
+{
+	std::vector<uint64_t> values = {0, ~0ULL};
+	for(int i = 0; i < 64; ++i)
+	{
+		const uint64_t bit = 1ULL << i;
+		values.insert(values.end(), {bit, ~bit, bit - 1, ~(bit - 1)});
+	}
+	for(const int& byte: {0x01, 0x0F, 0x33, 0x55, 0x7F, 0x80, 0xAA, 0xCC, 0xF0, 0xFE})
+		values.push_back(~0ULL / 0xFF * byte);
+	for(uint64_t n = 0; n < (1 << 16); ++n)  // every byte and 16-bit integer.
+		values.push_back(n);
+	
+	uint64_t state = seed;
+	for(size_t i = 0; i < randomCount; ++i)
+	{
+		const uint64_t x = split_mix(state), y = split_mix(state), z = split_mix(state);
+		values.insert(values.end(), {x, x & y & z, x | y | z});
+	}
+	return values;
+}
+
+template <typename T>
+static T make_value(uint64_t low, uint64_t)
+{
+	return static_cast<T>(low);
+}
+
+#if defined(__SIZEOF_INT128__)
+template <>
+unsigned __int128 make_value<unsigned __int128>(uint64_t low, uint64_t high)
+{
+	return static_cast<unsigned __int128>(high) << 64 | low;
+}
+#endif
+
+template <typename T>
+static void check_width(const char* type, const std::vector<uint64_t>& values, Report& report)
+{
+	for(size_t i = 0; i < values.size(); ++i)
+	{
+		// the high word of 128-bit values walks the values backwards.
+		const T n = make_value<T>(values[i], values[values.size() - 1 - i]);
+		const int expected = reference_popcount(n);
+		const int results[] = {popcount<T, ParallelPolicy>(n), popcount<T, HackerPolicy>(n), popcount<T, LookupPolicy>(n)};
+		const char* POLICY[] = {"ParallelPolicy", "HackerPolicy", "LookupPolicy"};
+		for(int p = 0; p < 3; ++p)
+			if(results[p] != expected)
+				report.fail("popcount<%s, %s>(values[%zu]) = %d, expected %d", type, POLICY[p], i, results[p], expected);
+		report.pass(3);
+	}
+}
+
+/*
+ * The 64-bit methods, and the constexpr templates evaluated at run time for every width.
+ */
+static bool check_wide()
+{
+	typedef int (*FUNC_POPCNT64)(uint64_t n);
+	const Method<FUNC_POPCNT64> METHOD64[] =
+	{
+		{hacker_popcnt64, "hacker_popcnt64", nullptr},
+		{hardware_popcnt64, "hardware_popcnt64", &CpuFeatures::popcnt},
+	};
+	
+	const std::vector<uint64_t> values = make_values(1 << 20, 0x5EED);
+	Report report("64-bit and constexpr");
+	for(const Method<FUNC_POPCNT64>& method: METHOD64)
+	{
+		if(!available(method))
+			continue;
+		for(const uint64_t& n: values)
+		{
+			const int result = method.pfunc(n), expected = reference_popcount(n);
+			if(result != expected)
+				report.fail("%s(0x%016llx) = %d, expected %d", method.name, static_cast<unsigned long long>(n), result, expected);
+		}
+		report.pass(values.size());
+	}
+	
+	check_width<uint8_t>("uint8_t", values, report);
+	check_width<uint16_t>("uint16_t", values, report);
+	check_width<uint32_t>("uint32_t", values, report);
+	check_width<uint64_t>("uint64_t", values, report);
+#if defined(__SIZEOF_INT128__)
+	check_width<unsigned __int128>("unsigned __int128", values, report);
+#endif
+	return report.finish();
+}
+
+/*
+ * Every length up to 1KB and longer ones in odd steps, each at all 64 byte offsets after the
+ * leading guard page, and ending right at the trailing one.
+ */
+static bool check_buffer()
+{
+	GuardedBuffer buffer(size_t(64) << 10);
+	fill_input(buffer.begin(), buffer.size(), DISTRIBUTION_RANDOM, 0x5EED);
+	std::vector<uint64_t> prefix(buffer.size() + 1, 0);  // bits set before each byte.
+	for(size_t i = 0; i < buffer.size(); ++i)
+		prefix[i + 1] = prefix[i] + reference_popcount(buffer.begin()[i]);
+	
+	constexpr size_t OFFSETS = 64;
+	std::vector<size_t> lengths;
+	for(size_t length = 0; length <= 1024; ++length)
+		lengths.push_back(length);
+	for(size_t length = 1025; length <= buffer.size() - OFFSETS; length += 997)
+		lengths.push_back(length);
+	lengths.push_back(buffer.size());
+	
+	Report report("buffer, odd lengths");
+	for(const Method<FUNC_POPCNT_BUFFER>& method: BUFFER_METHOD)
+	{
+		if(!available(method))
+			continue;
+		for(const size_t& length: lengths)
+		{
+			auto check = [&](size_t offset)
+			{
+				const uint64_t result = method.pfunc(buffer.begin() + offset, length);
+				const uint64_t expected = prefix[offset + length] - prefix[offset];
+				if(result != expected)
+					report.fail("%s at offset %zu of %zu bytes = %llu, expected %llu", method.name, offset, length,
+							static_cast<unsigned long long>(result), static_cast<unsigned long long>(expected));
+				else
+					report.pass(1);
+			};
+			
+			for(size_t offset = 0; offset < OFFSETS && offset + length <= buffer.size(); ++offset)
+				check(offset);
+			check(buffer.size() - length);
+		}
+	}
+	return report.finish();
+}
+
+static uint64_t combine(BitOperation operation, uint64_t x, uint64_t y)
+{
+	switch(operation)
+	{
+	case BIT_AND: return x & y;
+	case BIT_OR:  return x | y;
+	case BIT_XOR: return x ^ y;
+	default:      return x & ~y;
+	}
+}
+
+/*
+ * The fused kernels, one bitmap at each word offset after a guard page and the other ending at
+ * one, then the other way round.
+ */
+static bool check_pair()
+{
+	constexpr size_t WORDS = 2048, OFFSETS = 8;
+	GuardedBuffer bufferA(WORDS * sizeof(uint64_t)), bufferB(WORDS * sizeof(uint64_t));
+	fill_input(bufferA.begin(), bufferA.size(), DISTRIBUTION_BITMAP, 0x5EED);
+	fill_input(bufferB.begin(), bufferB.size(), DISTRIBUTION_RANDOM, 0x5EED + 1);
+	const uint64_t* beginA = reinterpret_cast<const uint64_t*>(bufferA.begin());
+	const uint64_t* endA = reinterpret_cast<const uint64_t*>(bufferA.end());
+	const uint64_t* beginB = reinterpret_cast<const uint64_t*>(bufferB.begin());
+	const uint64_t* endB = reinterpret_cast<const uint64_t*>(bufferB.end());
+	
+	std::vector<size_t> counts;
+	for(size_t count = 0; count <= 300; ++count)
+		counts.push_back(count);
+	for(size_t count = 301; count <= WORDS - OFFSETS; count += 97)
+		counts.push_back(count);
+	
+	Report report("pair, odd lengths");
+	for(int o = 0; o < BIT_OPERATION_COUNT; ++o)
+	{
+		const BitOperation operation = static_cast<BitOperation>(o);
+		std::vector<const PairMethod*> methods;
+		for(const PairMethod& method: PAIR_METHOD)
+			if(method.operation == operation && available(method))
+				methods.push_back(&method);
+		
+		for(const size_t& count: counts)
+			for(size_t offset = 0; offset < OFFSETS; ++offset)
+				for(int flip = 0; flip < 2; ++flip)
+				{
+					const uint64_t* a = flip ? endA - count : beginA + offset;
+					const uint64_t* b = flip ? beginB + offset : endB - count;
+					uint64_t expected = 0;
+					for(size_t i = 0; i < count; ++i)
+						expected += reference_popcount(combine(operation, a[i], b[i]));
+					
+					for(const PairMethod* method: methods)
+					{
+						const uint64_t result = method->pfunc(a, b, count);
+						if(result != expected)
+							report.fail("%s of %zu words at offset %zu = %llu, expected %llu", method->name, count, offset,
+									static_cast<unsigned long long>(result), static_cast<unsigned long long>(expected));
+						else
+							report.pass(1);
+					}
+				}
+	}
+	return report.finish();
+}
+
+static void reference_positional(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	for(size_t i = 0; i < count; ++i)
+		for(uint64_t word = words[i]; word != 0; word &= word - 1)
+		{
+			int bit = 0;
+			while(((word >> bit) & 1) == 0)
+				++bit;
+			++counts[bit];
+		}
+}
+
+/*
+ * The positional kernels next to guard pages, the counts start from nonzero values since they're
+ * added to. A last array is long enough that the 16-bit counters of the SIMD kernels overflow.
+ */
+static bool check_positional()
+{
+	constexpr size_t WORDS = 2048, OFFSETS = 8;
+	GuardedBuffer buffer(WORDS * sizeof(uint64_t));
+	fill_input(buffer.begin(), buffer.size(), DISTRIBUTION_BITMAP, 0x5EED);
+	const uint64_t* begin = reinterpret_cast<const uint64_t*>(buffer.begin());
+	const uint64_t* end = reinterpret_cast<const uint64_t*>(buffer.end());
+	
+	std::vector<size_t> counts;
+	for(size_t count = 0; count <= 300; ++count)
+		counts.push_back(count);
+	for(size_t count = 301; count <= WORDS - OFFSETS; count += 97)
+		counts.push_back(count);
+	
+	std::vector<uint64_t> large(size_t(64) * 65536 + 37);
+	fill_input(large.data(), large.size() * sizeof(uint64_t), DISTRIBUTION_DENSE, 0x5EED + 1);
+	uint64_t largeExpected[64] = {0};
+	reference_positional(large.data(), large.size(), largeExpected);
+	
+	Report report("positional, odd lengths");
+	auto check = [&](const Method<FUNC_POSITIONAL_POPCNT>& method, const uint64_t* words, size_t count, const uint64_t expected[64])
+	{
+		uint64_t result[64];
+		for(int i = 0; i < 64; ++i)
+			result[i] = i;
+		method.pfunc(words, count, result);
+		for(int i = 0; i < 64; ++i)
+			if(result[i] != expected[i] + i)
+			{
+				report.fail("%s of %zu words: counts[%d] = %llu, expected %llu", method.name, count, i,
+						static_cast<unsigned long long>(result[i] - i), static_cast<unsigned long long>(expected[i]));
+				return;
+			}
+		report.pass(1);
+	};
+	
+	for(const Method<FUNC_POSITIONAL_POPCNT>& method: POSITIONAL_METHOD)
+	{
+		if(!available(method))
+			continue;
+		for(const size_t& count: counts)
+			for(size_t offset = 0; offset <= OFFSETS; ++offset)
+			{
+				// the last offset ends the words at the trailing guard page.
+				const uint64_t* words = offset < OFFSETS ? begin + offset : end - count;
+				uint64_t expected[64] = {0};
+				reference_positional(words, count, expected);
+				check(method, words, count, expected);
+			}
+		check(method, large.data(), large.size(), largeExpected);
+	}
+	return report.finish();
+}
+
+bool cross_check(ThreadPool& pool)
+{
+	printf("cross-check against a bit-by-bit reference, the 32-bit space takes a while on %u threads\n\n",
+			pool.size());
+	
+	bool passed = check_scalar(pool);
+	passed &= check_wide();
+	passed &= check_buffer();
+	passed &= check_pair();
+	passed &= check_positional();
+	printf("\n%s\n", passed ? "every method agrees" : "some methods DISAGREE");
+	return passed;
+}
@@ -0,0 +1,17 @@
+#ifndef GITHUB_KALO2_POPCOUNT_CHECK_
+#define GITHUB_KALO2_POPCOUNT_CHECK_
+
+#include "thread_pool.h"
+
+/**
+ * Cross-check every method the CPU supports against a bit-by-bit reference: the scalar methods
+ * over the whole 32-bit space on the threads of @p pool, the 64-bit and constexpr methods over
+ * edge patterns and random values, and the buffer, pair and positional kernels over odd lengths
+ * and unaligned pointers next to inaccessible pages, so an over-read faults.
+ *
+ * The first failures of each part are printed.
+ * @return true if every method agrees with the reference.
+ */
+bool cross_check(ThreadPool& pool);
+
+#endif  // GITHUB_KALO2_POPCOUNT_CHECK_
@@ -0,0 +1,129 @@
+#include <cstdint>
+
+#include "cpu_features.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define CPU_X86 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPU_X86 1
+#else
+#define CPU_X86 0
+#endif
+
+#if CPU_X86
+
+/*
+ * Registers EAX, EBX, ECX and EDX of CPUID @p leaf, @p subleaf. A leaf beyond the maximum gives 0s.
+ */
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4])
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, leaf & 0x80000000);  // the maximum basic or extended leaf.
+	if(static_cast<uint32_t>(info[0]) < leaf)
+	{
+		registers[0] = registers[1] = registers[2] = registers[3] = 0;
+		return;
+	}
+	__cpuidex(info, leaf, subleaf);
+	for(int i = 0; i < 4; ++i)
+		registers[i] = static_cast<uint32_t>(info[i]);
+#else
+	unsigned int a = 0, b = 0, c = 0, d = 0;
+	if(!__get_cpuid_count(leaf, subleaf, &a, &b, &c, &d))
+		a = b = c = d = 0;
+	registers[0] = a;
+	registers[1] = b;
+	registers[2] = c;
+	registers[3] = d;
+#endif
+}
+
+/*
+ * XCR0 tells which register states the OS saves, read it only if OSXSAVE is set.
+ */
+static uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t low, high;
+	__asm__ volatile("xgetbv": "=a"(low), "=d"(high): "c"(0));
+	return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+}
+
+static CpuFeatures detect()
+{
+	CpuFeatures features = {false, false, false, false, false, false, false, false};
+	uint32_t leaf1[4], leaf7[4], extended1[4];
+	cpuid(1, 0, leaf1);
+	cpuid(7, 0, leaf7);
+	cpuid(0x80000001, 0, extended1);
+
+	const bool osxsave = (leaf1[2] >> 27) & 1;
+	const uint64_t xcr0 = osxsave? xgetbv0(): 0;
+	const bool ymm = (xcr0 & 0x06) == 0x06;  // XMM and YMM states.
+	const bool zmm = (xcr0 & 0xE6) == 0xE6;  // plus opmask and ZMM states.
+
+	features.popcnt = (leaf1[2] >> 23) & 1;
+	features.bmi1 = (leaf7[1] >> 3) & 1;
+	features.bmi2 = (leaf7[1] >> 8) & 1;
+	features.avx2 = ymm && ((leaf1[2] >> 28) & 1) && ((leaf7[1] >> 5) & 1);
+	features.avx512_vpopcntdq = zmm && ((leaf7[1] >> 16) & 1) && ((leaf7[2] >> 14) & 1);
+
+	// all the bits of a level must be set, e.g. v2 is SSE3, SSSE3, CMPXCHG16B, SSE4.1, SSE4.2 and
+	// POPCNT in leaf 1 ECX, with LAHF/SAHF in extended leaf 1 ECX.
+	auto has = [](uint32_t value, uint32_t bits) { return (value & bits) == bits; };
+	features.x86_64_v2 = has(leaf1[2], 0x00982201) && has(extended1[2], 0x00000001);
+	features.x86_64_v3 = features.x86_64_v2 && ymm && features.avx2 && features.bmi1 && features.bmi2
+			&& has(leaf1[2], 0x34401000)     // FMA, MOVBE, XSAVE, AVX and F16C.
+			&& has(extended1[2], 0x00000020);  // LZCNT.
+	features.x86_64_v4 = features.x86_64_v3 && zmm
+			&& has(leaf7[1], 0xD0030000);  // AVX512F, AVX512DQ, AVX512CD, AVX512BW and AVX512VL.
+	return features;
+}
+
+#else  // no CPUID, only portable code runs.
+
+static CpuFeatures detect()
+{
+	CpuFeatures features = {false, false, false, false, false, false, false, false};
+	return features;
+}
+
+#endif  // CPU_X86
+
+const CpuFeatures& cpu_features()
+{
+	static const CpuFeatures features = detect();
+	return features;
+}
+
+std::string describe(const CpuFeatures& features)
+{
+	const struct Flag
+	{
+		bool CpuFeatures::* flag;
+		const char* name;
+	} FLAG[] =
+	{
+		{&CpuFeatures::popcnt, "popcnt"},
+		{&CpuFeatures::bmi1, "bmi1"},
+		{&CpuFeatures::bmi2, "bmi2"},
+		{&CpuFeatures::avx2, "avx2"},
+		{&CpuFeatures::avx512_vpopcntdq, "avx512_vpopcntdq"},
+		{&CpuFeatures::x86_64_v2, "x86-64-v2"},
+		{&CpuFeatures::x86_64_v3, "x86-64-v3"},
+		{&CpuFeatures::x86_64_v4, "x86-64-v4"},
+	};
+
+	std::string text;
+	for(const Flag& flag: FLAG)
+		if(features.*flag.flag)
+			text += text.empty()? flag.name: std::string(" ") + flag.name;
+	return text.empty()? "none": text;
+}
@@ -0,0 +1,34 @@
+#ifndef GITHUB_KALO2_POPCOUNT_CPU_FEATURES_
+#define GITHUB_KALO2_POPCOUNT_CPU_FEATURES_
+
+#include <string>
+
+/**
+ * Instruction set extensions that popcount cares about. A flag is set only if both the CPU and
+ * the operating system support it, e.g. AVX needs the OS to save YMM registers on context switch.
+ */
+struct CpuFeatures
+{
+	bool popcnt;
+	bool bmi1;
+	bool bmi2;
+	bool avx2;
+	bool avx512_vpopcntdq;  ///< AVX512F and AVX512_VPOPCNTDQ.
+
+	// x86-64 micro-architecture levels of the psABI, each includes the one before.
+	bool x86_64_v2;  ///< POPCNT, SSE4.2, SSSE3, CMPXCHG16B and LAHF/SAHF.
+	bool x86_64_v3;  ///< AVX2, BMI1, BMI2, F16C, FMA, LZCNT and MOVBE.
+	bool x86_64_v4;  ///< AVX512F, AVX512BW, AVX512CD, AVX512DQ and AVX512VL.
+};
+
+/**
+ * Features of the running CPU, they are detected with CPUID on the first call.
+ */
+const CpuFeatures& cpu_features();
+
+/**
+ * @return text like "popcnt bmi1 bmi2 avx2 x86-64-v2 x86-64-v3", or "none".
+ */
+std::string describe(const CpuFeatures& features);
+
+#endif  // GITHUB_KALO2_POPCOUNT_CPU_FEATURES_
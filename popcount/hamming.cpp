@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "cpu_features.h"
+#include "hamming.h"
+#include "popcount.h"
+#include "popcount_constexpr.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAMMING_X86 1
+#else
+#define HAMMING_X86 0
+#endif
+
+#if defined(__GNUC__)
+#define HAMMING_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define HAMMING_INLINE __forceinline
+#else
+#define HAMMING_INLINE inline
+#endif
+
+static bool operator<(const Neighbor& a, const Neighbor& b)
+{
+	return a.distance != b.distance? a.distance < b.distance: a.index < b.index;
+}
+
+/*
+ * The k nearest neighbours seen so far, the root of the max-heap is the farthest of them.
+ */
+class BoundedHeap
+{
+private:
+	std::vector<Neighbor> heap;
+	size_t k;
+
+public:
+	explicit BoundedHeap(size_t k):
+			k(k)
+	{
+		heap.reserve(k);
+	}
+
+	/*
+	 * A code is kept only if it's nearer than the bound.
+	 */
+	uint32_t bound() const
+	{
+		return heap.size() < k? UINT32_MAX: heap.front().distance;
+	}
+
+	void push(uint32_t distance, size_t index)
+	{
+		const Neighbor neighbor = {distance, index};
+		if(heap.size() == k)
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.pop_back();
+		}
+		heap.push_back(neighbor);
+		std::push_heap(heap.begin(), heap.end());
+	}
+
+	const std::vector<Neighbor>& items() const
+	{
+		return heap;
+	}
+};
+
+// 4KB of codes per block, so a block stays in L1 cache while every query is compared with it.
+static constexpr size_t BLOCK_BYTES = 4096;
+
+/*
+	The distance kernel is written once and inlined into two callers, one compiled for POPCNT and
+	one for the baseline ISA. __builtin_popcountll becomes the instruction only in the former.
+	Off x86 only the portable caller exists.
+*/
+template <int WORDS, bool HARDWARE>
+static HAMMING_INLINE void scan_codes(const uint64_t* codes, size_t begin, size_t end,
+		const uint64_t* queries, size_t queryCount, BoundedHeap* heaps)
+{
+	const size_t blockCodes = BLOCK_BYTES / (WORDS * sizeof(uint64_t));
+	for(size_t block = begin; block < end; block += blockCodes)
+	{
+		const size_t stop = std::min(end, block + blockCodes);
+		for(size_t q = 0; q < queryCount; ++q)
+		{
+			uint64_t query[WORDS];
+			std::copy(queries + q * WORDS, queries + (q + 1) * WORDS, query);
+			BoundedHeap& heap = heaps[q];
+			uint32_t bound = heap.bound();
+			for(size_t i = block; i < stop; ++i)
+			{
+				const uint64_t* code = codes + i * WORDS;
+				uint32_t distance = 0;
+				for(int w = 0; w < WORDS; ++w)
+#if HAMMING_X86
+					distance += HARDWARE? __builtin_popcountll(code[w] ^ query[w]): popcount<uint64_t>(code[w] ^ query[w]);
+#else
+					distance += popcount<uint64_t>(code[w] ^ query[w]);
+#endif
+				if(distance < bound)  // codes come in ascending index, so a tie never replaces.
+				{
+					heap.push(distance, i);
+					bound = heap.bound();
+				}
+			}
+		}
+	}
+}
+
+#if HAMMING_X86
+template <int WORDS>
+__attribute__((target("popcnt")))
+static void scan_hardware(const uint64_t* codes, size_t begin, size_t end,
+		const uint64_t* queries, size_t queryCount, BoundedHeap* heaps)
+{
+	scan_codes<WORDS, true>(codes, begin, end, queries, queryCount, heaps);
+}
+#endif
+
+template <int WORDS>
+static void scan_portable(const uint64_t* codes, size_t begin, size_t end,
+		const uint64_t* queries, size_t queryCount, BoundedHeap* heaps)
+{
+	scan_codes<WORDS, false>(codes, begin, end, queries, queryCount, heaps);
+}
+
+typedef void (*FUNC_SCAN)(const uint64_t* codes, size_t begin, size_t end,
+		const uint64_t* queries, size_t queryCount, BoundedHeap* heaps);
+
+static FUNC_SCAN select_scan(int words, const CpuFeatures& features)
+{
+	static const FUNC_SCAN PORTABLE[] =
+	{
+		scan_portable<1>, scan_portable<2>, scan_portable<3>, scan_portable<4>,
+		scan_portable<5>, scan_portable<6>, scan_portable<7>, scan_portable<8>,
+	};
+#if HAMMING_X86
+	static const FUNC_SCAN HARDWARE[] =
+	{
+		scan_hardware<1>, scan_hardware<2>, scan_hardware<3>, scan_hardware<4>,
+		scan_hardware<5>, scan_hardware<6>, scan_hardware<7>, scan_hardware<8>,
+	};
+	if(features.popcnt)
+		return HARDWARE[words - 1];
+#else
+	(void)features;
+#endif
+	return PORTABLE[words - 1];
+}
+
+static int check_bits(int bits) noexcept(false)
+{
+	if(bits < 64 || bits > 512 || bits % 64 != 0)
+		throw std::invalid_argument("a code has 64 to 512 bits in multiples of 64");
+	return bits / 64;
+}
+
+HammingIndex::HammingIndex(const uint64_t* codes, size_t count, int bits) noexcept(false):
+		codes(codes),
+		count(count),
+		words(check_bits(bits))
+{
+}
+
+HammingIndex::HammingIndex(const std::string& path, int bits) noexcept(false):
+		codes(nullptr),
+		count(0),
+		words(check_bits(bits))
+{
+	file.reset(new MappedFile(path));
+	const size_t codeSize = words * sizeof(uint64_t);
+	if(file->size() % codeSize != 0)
+		throw std::invalid_argument(path + " doesn't hold whole codes of " + std::to_string(bits) + " bits");
+
+	codes = reinterpret_cast<const uint64_t*>(file->data());  // a mapping is page aligned.
+	count = file->size() / codeSize;
+}
+
+size_t HammingIndex::size() const
+{
+	return count;
+}
+
+int HammingIndex::bits() const
+{
+	return words * 64;
+}
+
+/*
+ * Merge the heaps of query @p q from all threads, nearest first.
+ */
+static std::vector<Neighbor> merge(const std::vector<std::vector<BoundedHeap>>& heaps, size_t q, size_t k)
+{
+	std::vector<Neighbor> neighbors;
+	for(const std::vector<BoundedHeap>& slice: heaps)
+		neighbors.insert(neighbors.end(), slice[q].items().begin(), slice[q].items().end());
+	std::sort(neighbors.begin(), neighbors.end());
+	if(neighbors.size() > k)
+		neighbors.resize(k);
+	return neighbors;
+}
+
+std::vector<std::vector<Neighbor>> HammingIndex::search(const uint64_t* queries, size_t queryCount, size_t k,
+		unsigned threads) const
+{
+	std::vector<std::vector<Neighbor>> result(queryCount);
+	if(k == 0 || count == 0)
+		return result;
+
+	// a slice is at least a few blocks, or threads cost more than they save.
+	const size_t minimumSlice = 16 * BLOCK_BYTES / (words * sizeof(uint64_t));
+	if(threads == 0)
+		threads = std::max(1U, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned>(std::min<size_t>(threads, (count + minimumSlice - 1) / minimumSlice));
+
+	const FUNC_SCAN scan = select_scan(words, cpu_features());
+	std::vector<std::vector<BoundedHeap>> heaps(threads, std::vector<BoundedHeap>(queryCount, BoundedHeap(k)));
+	auto run = [&](unsigned t)
+	{
+		const size_t begin = count * t / threads, end = count * (t + 1) / threads;
+		scan(codes, begin, end, queries, queryCount, heaps[t].data());
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned t = 1; t < threads; ++t)
+		workers.emplace_back(run, t);
+	run(0);  // the calling thread takes the first slice.
+	for(std::thread& worker: workers)
+		worker.join();
+
+	for(size_t q = 0; q < queryCount; ++q)
+		result[q] = merge(heaps, q, k);
+	return result;
+}
+
+std::vector<std::vector<Neighbor>> HammingIndex::search_brute_force(const uint64_t* queries, size_t queryCount,
+		size_t k) const
+{
+	std::vector<std::vector<Neighbor>> result(queryCount);
+	std::vector<Neighbor> all(count);
+	for(size_t q = 0; q < queryCount; ++q)
+	{
+		const uint64_t* query = queries + q * words;
+		for(size_t i = 0; i < count; ++i)
+		{
+			all[i].distance = static_cast<uint32_t>(popcount_xor(codes + i * words, query, words));
+			all[i].index = i;
+		}
+
+		const size_t n = std::min(k, count);
+		std::partial_sort(all.begin(), all.begin() + n, all.end());
+		result[q].assign(all.begin(), all.begin() + n);
+	}
+	return result;
+}
@@ -0,0 +1,70 @@
+#ifndef GITHUB_KALO2_POPCOUNT_HAMMING_
+#define GITHUB_KALO2_POPCOUNT_HAMMING_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+/**
+ * A code of the index and its Hamming distance to a query.
+ */
+struct Neighbor
+{
+	uint32_t distance;
+	size_t index;
+};
+
+/**
+ * Nearest neighbour search over binary codes of 64 to 512 bits, e.g. the hashes of images or
+ * documents. The codes are stored back to back, a code of w bits takes w / 64 words.
+ *
+ * A search scans every code. The codes are read in blocks that stay in L1 cache, and each block
+ * is compared with all queries before the next block is read, so memory is read once per search
+ * rather than once per query. Each thread scans a slice of codes with its own top-k heaps, the
+ * heaps are merged at the end.
+ */
+class HammingIndex
+{
+private:
+	std::unique_ptr<MappedFile> file;  // nullptr if the codes are borrowed.
+	const uint64_t* codes;
+	size_t count;
+	int words;  // per code.
+
+public:
+	/**
+	 * Borrow @p count codes of @p bits at @p codes, they must outlive the index.
+	 * @throw std::invalid_argument if @p bits isn't a multiple of 64 within [64, 512].
+	 */
+	HammingIndex(const uint64_t* codes, size_t count, int bits) noexcept(false);
+
+	/**
+	 * Map a file of codes of @p bits, each code is stored as little-endian 64-bit words.
+	 * @throw std::invalid_argument if @p bits is wrong or the file size isn't a multiple of the code size.
+	 * @throw std::runtime_error if the file can't be mapped.
+	 */
+	HammingIndex(const std::string& path, int bits) noexcept(false);
+
+	size_t size() const;
+	int bits() const;
+
+	/**
+	 * Find the @p k nearest codes of each query, @p queryCount queries are stored back to back at
+	 * @p queries. Ties go to the smaller index.
+	 * @param threads 0 for the number of hardware threads.
+	 * @return the neighbours of each query, nearest first.
+	 */
+	std::vector<std::vector<Neighbor>> search(const uint64_t* queries, size_t queryCount, size_t k,
+			unsigned threads = 0) const;
+
+	/**
+	 * The same result as search(), by computing every distance with popcount_xor() and sorting.
+	 */
+	std::vector<std::vector<Neighbor>> search_brute_force(const uint64_t* queries, size_t queryCount, size_t k) const;
+};
+
+#endif  // GITHUB_KALO2_POPCOUNT_HAMMING_
@@ -0,0 +1,779 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "check.h"
+#include "cpu_features.h"
+#include "hamming.h"
+#include "mapped_file.h"
+#include "methods.h"
+#include "parallel_popcount.h"
+#include "popcount.h"
+#include "rank_select.h"
+
+/*
+ * How the calls of a scalar method are chained.
+ */
+enum ScalarMode
+{
+	SCALAR_THROUGHPUT,  ///< independent calls, out-of-order execution overlaps them.
+	SCALAR_LATENCY,     ///< each result feeds the next input, so a call waits for the one before.
+};
+
+// zero, but the compiler can't know it, so the chain of the latency mode can't be optimized away.
+static volatile uint32_t chainMask = 0;
+
+/*
+ * Cycles per call of the scalar methods over each input distribution.
+ */
+static void benchmark_scalar(ScalarMode mode)
+{
+	// Inputs are random rather than sequential, sequential integers have few bits and favor
+	// branchy methods. 256KB of them stay in L2 cache, so memory isn't measured here.
+	constexpr size_t N = 1 << 16;
+	constexpr int WARMUP = 2, TRIALS = 21;
+	std::vector<uint32_t> inputs[DISTRIBUTION_COUNT];
+	uint64_t references[DISTRIBUTION_COUNT];
+	for(int d = 0; d < DISTRIBUTION_COUNT; ++d)
+	{
+		inputs[d].resize(N);
+		fill_input(inputs[d].data(), N * sizeof(uint32_t), static_cast<Distribution>(d), 0x5EED + d);
+		references[d] = 0;
+		for(const uint32_t& n: inputs[d])
+			references[d] += iterated_popcnt(n);
+	}
+	
+	CycleCounter counter;
+	std::vector<std::string> header(1, "method");
+	header.insert(header.end(), DISTRIBUTION_TEXT, DISTRIBUTION_TEXT + DISTRIBUTION_COUNT);
+	Table table(header);
+	
+	for(const Method<FUNC_POPCNT>& method: SCALAR_METHOD)
+	{
+		if(!method.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", method.name);
+			continue;
+		}
+		
+		std::vector<std::string> row(1, method.name);
+		for(int d = 0; d < DISTRIBUTION_COUNT; ++d)
+		{
+			const std::vector<uint32_t>& input = inputs[d];
+			uint64_t checksum = 0;
+			auto trial = [&]() -> double
+			{
+				uint64_t start = counter.now();
+				uint64_t sum = 0;
+				if(mode == SCALAR_LATENCY)
+				{
+					// the input is xored with result & 0, which leaves it intact but waits for the result.
+					const uint32_t mask = chainMask;
+					uint32_t result = 0;
+					for(const uint32_t& n: input)
+					{
+						result = static_cast<uint32_t>(method.pfunc(n ^ (result & mask)));
+						sum += result;
+					}
+				}
+				else
+				{
+					for(const uint32_t& n: input)
+						sum += method.pfunc(n);
+				}
+				uint64_t stop = counter.now();
+				
+				consume(sum);
+				checksum = sum;
+				return static_cast<double>(stop - start) / N;
+			};
+			
+			std::string cell = Table::format(summarize(run_trials(trial, WARMUP, TRIALS)));
+			if(checksum != references[d])  // disagree with iterated_popcnt
+				cell += " WRONG";
+			row.push_back(cell);
+		}
+		table.add_row(row);
+	}
+	
+	if(mode == SCALAR_LATENCY)
+		printf("scalar methods, latency in %s per call of a dependent chain, which adds an and and an xor, "
+				"median [95%% confidence interval] of %d trials, %zu calls each\n\n", counter.unit(), TRIALS, N);
+	else
+		printf("scalar methods, throughput in %s per call of independent calls, "
+				"median [95%% confidence interval] of %d trials, %zu calls each\n\n", counter.unit(), TRIALS, N);
+	table.print();
+}
+
+/*
+ * GB/s of the buffer back ends, from a buffer fitting in L1 cache to one that must come from DRAM.
+ */
+static void benchmark_buffer()
+{
+	const struct Size
+	{
+		size_t size;
+		const char* name;
+	} SIZE[] =
+	{
+		{size_t(16) << 10, "16KB (L1)"},
+		{size_t(1) << 20, "1MB (L2)"},
+		{size_t(32) << 20, "32MB (L3)"},
+		{size_t(512) << 20, "512MB (DRAM)"},
+	};
+	
+	// a small buffer is counted many times in a trial, so that a trial isn't too short to time.
+	constexpr size_t TRIAL_SIZE = size_t(64) << 20;
+	constexpr int WARMUP = 1, TRIALS = 7;
+	constexpr size_t sizeCount = sizeof(SIZE) / sizeof(SIZE[0]);
+	std::vector<uint64_t> words(SIZE[sizeCount - 1].size / sizeof(uint64_t));
+	fill_input(words.data(), words.size() * sizeof(uint64_t), DISTRIBUTION_RANDOM, 0x5EED);
+	
+	std::vector<std::string> header(1, "back end");
+	for(const Size& size: SIZE)
+		header.push_back(size.name);
+	Table table(header);
+	
+	for(const Method<FUNC_POPCNT_BUFFER>& backend: BUFFER_METHOD)
+	{
+		if(!backend.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", backend.name);
+			continue;
+		}
+		
+		std::vector<std::string> row(1, backend.name);
+		for(const Size& size: SIZE)
+		{
+			const uint64_t reference = hacker_popcnt_buffer(words.data(), size.size);
+			const size_t repeat = std::max<size_t>(1, TRIAL_SIZE / size.size);
+			bool wrong = false;
+			auto trial = [&]() -> double
+			{
+				auto start = std::chrono::steady_clock::now();
+				for(size_t r = 0; r < repeat; ++r)
+				{
+					uint64_t count = backend.pfunc(words.data(), size.size);
+					consume(count);
+					wrong |= count != reference;
+				}
+				auto stop = std::chrono::steady_clock::now();
+				
+				std::chrono::duration<double> seconds = stop - start;
+				return static_cast<double>(size.size) * repeat / seconds.count() / 1e9;
+			};
+			
+			std::string cell = Table::format(summarize(run_trials(trial, WARMUP, TRIALS)));
+			if(wrong)
+				cell += " WRONG";
+			row.push_back(cell);
+		}
+		table.add_row(row);
+	}
+	
+	const FUNC_POPCNT_BUFFER selected = select_popcnt_buffer(cpu_features());
+	const char* selectedName = "unknown";
+	for(const Method<FUNC_POPCNT_BUFFER>& backend: BUFFER_METHOD)
+		if(backend.pfunc == selected)
+			selectedName = backend.name;
+	
+	printf("buffer back ends, GB/s, median [95%% confidence interval] of %d trials\n", TRIALS);
+	printf("popcount_buffer dispatches to %s\n\n", selectedName);
+	table.print();
+}
+
+/*
+ * Cycles per word of the positional back ends over each input distribution.
+ */
+static void benchmark_positional()
+{
+	// 256KB of words stay in L2 cache, the kernels are bound by computation rather than memory.
+	constexpr size_t N = 1 << 15;
+	constexpr int WARMUP = 2, TRIALS = 21;
+	std::vector<uint64_t> inputs[DISTRIBUTION_COUNT];
+	std::vector<uint64_t> references[DISTRIBUTION_COUNT];
+	for(int d = 0; d < DISTRIBUTION_COUNT; ++d)
+	{
+		inputs[d].resize(N);
+		fill_input(inputs[d].data(), N * sizeof(uint64_t), static_cast<Distribution>(d), 0x5EED + d);
+		references[d].assign(64, 0);
+		iterated_positional_popcnt(inputs[d].data(), N, references[d].data());
+	}
+	
+	CycleCounter counter;
+	std::vector<std::string> header(1, "back end");
+	header.insert(header.end(), DISTRIBUTION_TEXT, DISTRIBUTION_TEXT + DISTRIBUTION_COUNT);
+	Table table(header);
+	
+	for(const Method<FUNC_POSITIONAL_POPCNT>& positional: POSITIONAL_METHOD)
+	{
+		if(!positional.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", positional.name);
+			continue;
+		}
+		
+		std::vector<std::string> row(1, positional.name);
+		for(int d = 0; d < DISTRIBUTION_COUNT; ++d)
+		{
+			uint64_t counts[64];
+			auto trial = [&]() -> double
+			{
+				std::fill(counts, counts + 64, 0);
+				uint64_t start = counter.now();
+				positional.pfunc(inputs[d].data(), N, counts);
+				uint64_t stop = counter.now();
+				
+				consume(counts[0]);
+				return static_cast<double>(stop - start) / N;
+			};
+			
+			std::string cell = Table::format(summarize(run_trials(trial, WARMUP, TRIALS)));
+			if(!std::equal(counts, counts + 64, references[d].begin()))  // disagree with the bit by bit counts
+				cell += " WRONG";
+			row.push_back(cell);
+		}
+		table.add_row(row);
+	}
+	
+	printf("positional back ends, %s per word, median [95%% confidence interval] of %d trials, %zu words each\n\n",
+			counter.unit(), TRIALS, N);
+	table.print();
+}
+
+/*
+ * Cycles per 32 bits of the table methods against the arithmetic ones, quiet and with an adversary
+ * that evicts L1 or L2 between batches of calls. The batch sweeps from 16 to 64K calls and each
+ * table shows the cycles added over quiet, so the cost to a method grows as the evictions get more
+ * frequent. Only the batches are timed, so what the adversary adds is the cost to the method, namely
+ * refilling its table and reloading its input.
+ */
+static void benchmark_cache_pressure()
+{
+	constexpr size_t N = 1 << 16;
+	constexpr size_t EVICTIONS = 64;  // per trial at most, the small batches count a part of the input.
+	constexpr int WARMUP = 1, TRIALS = 15;
+	const size_t BATCH[] = {16, 256, 1 << 12, N};
+	std::vector<uint32_t> input(N);
+	fill_input(input.data(), N * sizeof(uint32_t), DISTRIBUTION_RANDOM, 0x5EED);
+	std::vector<uint64_t> reference(N + 1, 0);  // of the first i integers.
+	for(size_t i = 0; i < N; ++i)
+		reference[i + 1] = reference[i] + iterated_popcnt(input[i]);
+	
+	CacheEvictor l1(1), l2(2);
+	const struct Level
+	{
+		const char* name;
+		CacheEvictor* evictor;
+	} LEVEL[] =
+	{
+		{"L1", &l1},
+		{"L2", &l2},
+	};
+	constexpr size_t LEVEL_COUNT = sizeof(LEVEL) / sizeof(LEVEL[0]);
+	constexpr size_t BATCH_COUNT = sizeof(BATCH) / sizeof(BATCH[0]);
+	
+	typedef std::function<uint64_t(const uint32_t* integers, size_t count)> Count;
+	CycleCounter counter;
+	auto measure = [&](CacheEvictor* evictor, size_t batch, const Count& count, bool& wrong) -> Summary
+	{
+		const size_t covered = std::min(N, batch * EVICTIONS);
+		auto trial = [&]() -> double
+		{
+			uint64_t cycles = 0, sum = 0;
+			for(size_t i = 0; i < covered; i += batch)
+			{
+				if(evictor != nullptr)
+					evictor->evict();
+				uint64_t start = counter.now();
+				sum += count(input.data() + i, batch);
+				uint64_t stop = counter.now();
+				cycles += stop - start;
+			}
+			
+			consume(sum);
+			wrong |= sum != reference[covered];
+			return static_cast<double>(cycles) / covered;
+		};
+		return summarize(run_trials(trial, WARMUP, TRIALS));
+	};
+	
+	// a batch that counts nothing measures the timer, and whatever the adversary leaves running.
+	const Count empty = [](const uint32_t*, size_t) -> uint64_t { return 0; };
+	bool unused = false;
+	const double quietOverhead = measure(nullptr, N, empty, unused).median;
+	double overhead[LEVEL_COUNT][BATCH_COUNT];
+	for(size_t l = 0; l < LEVEL_COUNT; ++l)
+		for(size_t b = 0; b < BATCH_COUNT; ++b)
+			overhead[l][b] = measure(LEVEL[l].evictor, BATCH[b], empty, unused).median;
+	
+	std::vector<std::string> header = {"method", "quiet"};
+	for(size_t batch: BATCH)
+		header.push_back("/ " + (batch < 1024? std::to_string(batch): std::to_string(batch / 1024) + "K") + " calls");
+	std::vector<Table> tables(LEVEL_COUNT, Table(header));
+	
+	auto subtract = [](Summary summary, double cycles) -> Summary
+	{
+		summary.median -= cycles;
+		summary.low -= cycles;
+		summary.high -= cycles;
+		return summary;
+	};
+	auto add_rows = [&](const char* name, const Count& count)
+	{
+		bool wrong = false;
+		const Summary quiet = subtract(measure(nullptr, N, count, wrong), quietOverhead);
+		for(size_t l = 0; l < LEVEL_COUNT; ++l)
+		{
+			std::vector<std::string> row = {name, Table::format(quiet)};
+			for(size_t b = 0; b < BATCH_COUNT; ++b)
+			{
+				const Summary pressure = measure(LEVEL[l].evictor, BATCH[b], count, wrong);
+				row.push_back(Table::format(subtract(pressure, overhead[l][b] + quiet.median)));
+			}
+			if(wrong)
+				row[0] += " WRONG";
+			tables[l].add_row(row);
+		}
+	};
+	
+	for(const Method<FUNC_POPCNT>& method: SCALAR_METHOD)
+	{
+		if(!method.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", method.name);
+			continue;
+		}
+		add_rows(method.name, [&](const uint32_t* integers, size_t count) -> uint64_t
+		{
+			uint64_t sum = 0;
+			for(size_t i = 0; i < count; ++i)
+				sum += method.pfunc(integers[i]);
+			return sum;
+		});
+	}
+	for(const Method<FUNC_POPCNT_BUFFER>& backend: BUFFER_METHOD)
+	{
+		if(!backend.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", backend.name);
+			continue;
+		}
+		add_rows(backend.name, [&](const uint32_t* integers, size_t count) -> uint64_t
+		{
+			return backend.pfunc(integers, count * sizeof(uint32_t));
+		});
+	}
+	
+	for(size_t l = 0; l < LEVEL_COUNT; ++l)
+	{
+		printf("cache pressure, %s evicted every so many calls, %s per 32 bits quiet and added by the evictions, "
+				"which aren't timed, median [95%% confidence interval] of %d trials\n\n", LEVEL[l].name, counter.unit(), TRIALS);
+		tables[l].print();
+		if(l + 1 < LEVEL_COUNT)
+			printf("\n");
+	}
+}
+
+/*
+ * GB/s of the fused counts of two bitmaps, both bitmaps are counted in the bytes. A row that
+ * writes the intersection and then counts it shows what the fusion saves.
+ */
+static void benchmark_pair()
+{
+	std::vector<PairMethod> pairs(PAIR_METHOD);
+	pairs.push_back({nullptr, "materialized and + popcount_buffer", BIT_AND, nullptr});
+	
+	const struct Size
+	{
+		size_t size;  // of each bitmap.
+		const char* name;
+	} SIZE[] =
+	{
+		{size_t(8) << 10, "2 x 8KB (L1)"},
+		{size_t(512) << 10, "2 x 512KB (L2)"},
+		{size_t(256) << 20, "2 x 256MB (DRAM)"},
+	};
+	
+	constexpr size_t TRIAL_SIZE = size_t(64) << 20;
+	constexpr int WARMUP = 1, TRIALS = 7;
+	constexpr size_t sizeCount = sizeof(SIZE) / sizeof(SIZE[0]);
+	const size_t wordCount = SIZE[sizeCount - 1].size / sizeof(uint64_t);
+	std::vector<uint64_t> a(wordCount), b(wordCount), scratch(wordCount);
+	fill_input(a.data(), wordCount * sizeof(uint64_t), DISTRIBUTION_BITMAP, 0x5EED);
+	fill_input(b.data(), wordCount * sizeof(uint64_t), DISTRIBUTION_BITMAP, 0x5EED + 1);
+	
+	// the references come from iterated_popcnt over the materialized operation, word by word.
+	auto combine = [](BitOperation operation, uint64_t x, uint64_t y) -> uint64_t
+	{
+		switch(operation)
+		{
+		case BIT_AND: return x & y;
+		case BIT_OR:  return x | y;
+		case BIT_XOR: return x ^ y;
+		default:      return x & ~y;
+		}
+	};
+	uint64_t references[BIT_OPERATION_COUNT][sizeCount];
+	for(int o = 0; o < BIT_OPERATION_COUNT; ++o)
+		for(size_t s = 0; s < sizeCount; ++s)
+		{
+			uint64_t reference = 0;
+			for(size_t i = 0; i < SIZE[s].size / sizeof(uint64_t); ++i)
+			{
+				const uint64_t word = combine(static_cast<BitOperation>(o), a[i], b[i]);
+				reference += iterated_popcnt(static_cast<uint32_t>(word)) + iterated_popcnt(static_cast<uint32_t>(word >> 32));
+			}
+			references[o][s] = reference;
+		}
+	
+	std::vector<std::string> header(1, "kernel");
+	for(const Size& size: SIZE)
+		header.push_back(size.name);
+	Table table(header);
+	
+	for(const PairMethod& pair: pairs)
+	{
+		if(!pair.supported())
+		{
+			printf("%s is skipped, the CPU doesn't support it.\n", pair.name);
+			continue;
+		}
+		
+		std::vector<std::string> row(1, pair.name);
+		for(size_t s = 0; s < sizeCount; ++s)
+		{
+			const size_t count = SIZE[s].size / sizeof(uint64_t);
+			const size_t repeat = std::max<size_t>(1, TRIAL_SIZE / SIZE[s].size);
+			bool wrong = false;
+			auto trial = [&]() -> double
+			{
+				auto start = std::chrono::steady_clock::now();
+				for(size_t r = 0; r < repeat; ++r)
+				{
+					uint64_t result;
+					if(pair.pfunc != nullptr)
+						result = pair.pfunc(a.data(), b.data(), count);
+					else
+					{
+						for(size_t i = 0; i < count; ++i)
+							scratch[i] = a[i] & b[i];
+						result = popcount_buffer(scratch.data(), count * sizeof(uint64_t));
+					}
+					consume(result);
+					wrong |= result != references[pair.operation][s];
+				}
+				auto stop = std::chrono::steady_clock::now();
+				
+				std::chrono::duration<double> seconds = stop - start;
+				return 2.0 * SIZE[s].size * repeat / seconds.count() / 1e9;
+			};
+			
+			std::string cell = Table::format(summarize(run_trials(trial, WARMUP, TRIALS)));
+			if(wrong)
+				cell += " WRONG";
+			row.push_back(cell);
+		}
+		table.add_row(row);
+	}
+	
+	printf("fused counts of two bitmaps, GB/s, median [95%% confidence interval] of %d trials\n\n", TRIALS);
+	table.print();
+}
+
+/*
+ * Queries per second of the Hamming nearest neighbour search, and of the brute force that sorts
+ * every distance, over a million codes of each width.
+ */
+static void benchmark_hamming()
+{
+	constexpr size_t N = 1 << 20, QUERIES = 64, K = 10;
+	constexpr int WARMUP = 1, TRIALS = 5;
+	const unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+	
+	Table table({"code", "search QPS", "scanned Mcodes/s", "brute force QPS", "speedup"});
+	for(int bits = 64; bits <= 512; bits *= 2)
+	{
+		const size_t words = bits / 64;
+		std::vector<uint64_t> codes(N * words), queries(QUERIES * words);
+		fill_input(codes.data(), codes.size() * sizeof(uint64_t), DISTRIBUTION_RANDOM, 0x5EED + bits);
+		fill_input(queries.data(), queries.size() * sizeof(uint64_t), DISTRIBUTION_RANDOM, 0x5EED - bits);
+		const HammingIndex index(codes.data(), N, bits);
+		
+		std::vector<std::vector<Neighbor>> result, reference;
+		auto search = [&]() -> double
+		{
+			auto start = std::chrono::steady_clock::now();
+			result = index.search(queries.data(), QUERIES, K, threads);
+			auto stop = std::chrono::steady_clock::now();
+			
+			consume(result[0][0].index);
+			return QUERIES / std::chrono::duration<double>(stop - start).count();
+		};
+		auto brute = [&]() -> double
+		{
+			auto start = std::chrono::steady_clock::now();
+			reference = index.search_brute_force(queries.data(), QUERIES, K);
+			auto stop = std::chrono::steady_clock::now();
+			
+			consume(reference[0][0].index);
+			return QUERIES / std::chrono::duration<double>(stop - start).count();
+		};
+		
+		const Summary searchQps = summarize(run_trials(search, WARMUP, TRIALS));
+		const Summary bruteQps = summarize(run_trials(brute, 0, 3));
+		// a search scans each code once for all its queries.
+		const double scale = static_cast<double>(N) / QUERIES / 1e6;
+		const Summary codeRate = {searchQps.median * scale, searchQps.low * scale, searchQps.high * scale};
+		bool same = result.size() == reference.size();
+		for(size_t q = 0; same && q < result.size(); ++q)
+			same = result[q].size() == reference[q].size() && std::equal(result[q].begin(), result[q].end(),
+					reference[q].begin(), [](const Neighbor& a, const Neighbor& b)
+					{
+						return a.distance == b.distance && a.index == b.index;
+					});
+		
+		char speedup[32];
+		snprintf(speedup, sizeof(speedup), "%.1fx", searchQps.median / bruteQps.median);
+		table.add_row({std::to_string(bits) + " bits", Table::format(searchQps) + (same? "": " WRONG"),
+				Table::format(codeRate), Table::format(bruteQps), speedup});
+	}
+	
+	printf("Hamming top-%zu search, %zu codes, %zu queries per search, %u threads, "
+			"median [95%% confidence interval]\n\n", K, N, QUERIES, threads);
+	table.print();
+}
+
+/*
+ * Random rank and select latency in ns, over bit vectors from L2 cache size to beyond DRAM pages
+ * of the TLB. Each query depends on the result of the previous one, so they can't overlap.
+ */
+static void benchmark_rank_select()
+{
+	constexpr size_t QUERIES = 1 << 20;
+	constexpr int WARMUP = 1, TRIALS = 5;
+	
+	// maps a random word to [0, n) without a division, the high word of random * n.
+	auto scale = [](uint64_t random, uint64_t n) -> uint64_t
+	{
+#if defined(__SIZEOF_INT128__)
+		return static_cast<uint64_t>((static_cast<unsigned __int128>(random) * n) >> 64);
+#else
+		const uint64_t low = (random & 0xFFFFFFFF) * (n & 0xFFFFFFFF);
+		const uint64_t middle1 = (random >> 32) * (n & 0xFFFFFFFF) + (low >> 32);
+		const uint64_t middle2 = (random & 0xFFFFFFFF) * (n >> 32) + (middle1 & 0xFFFFFFFF);
+		return (random >> 32) * (n >> 32) + (middle1 >> 32) + (middle2 >> 32);
+#endif
+	};
+	
+	std::vector<uint64_t> randoms(QUERIES);
+	fill_input(randoms.data(), QUERIES * sizeof(uint64_t), DISTRIBUTION_RANDOM, 0x5EED);
+	
+	Table table({"bits", "overhead", "rank1 ns", "select1 ns"});
+	const char* tier = "";
+	for(uint64_t size = 1000000; size <= 10000000000ULL; size *= 10)
+	{
+		std::vector<uint64_t> words;
+		try
+		{
+			words.resize((size + 63) / 64);
+		}
+		catch(const std::bad_alloc&)
+		{
+			printf("%llu bits are skipped, out of memory.\n", static_cast<unsigned long long>(size));
+			continue;
+		}
+		fill_input(words.data(), words.size() * sizeof(uint64_t), DISTRIBUTION_RANDOM, 0x5EED + size);
+		const RankSelect index(words.data(), size);
+		tier = index.tier();
+		
+		bool wrong = false;
+		auto rank = [&]() -> double
+		{
+			uint64_t result = 0;
+			auto start = std::chrono::steady_clock::now();
+			for(const uint64_t& random: randoms)
+				result = index.rank1(scale(random ^ result, size + 1));
+			auto stop = std::chrono::steady_clock::now();
+			
+			consume(result);
+			return std::chrono::duration<double, std::nano>(stop - start).count() / QUERIES;
+		};
+		auto select = [&]() -> double
+		{
+			uint64_t result = 0;
+			auto start = std::chrono::steady_clock::now();
+			for(const uint64_t& random: randoms)
+				result = index.select1(scale(random ^ result, index.count()));
+			auto stop = std::chrono::steady_clock::now();
+			
+			consume(result);
+			return std::chrono::duration<double, std::nano>(stop - start).count() / QUERIES;
+		};
+		
+		// a set bit is found again by select1(rank1(i)).
+		for(size_t q = 0; q < 1024; ++q)
+		{
+			const size_t i = scale(randoms[q], size);
+			if((words[i / 64] >> (i % 64)) & 1)
+				wrong |= index.select1(index.rank1(i)) != i;
+		}
+		
+		char overhead[32];
+		snprintf(overhead, sizeof(overhead), "%.2f%%", 100.0 * index.space() / (words.size() * sizeof(uint64_t)));
+		table.add_row({std::to_string(size), overhead, Table::format(summarize(run_trials(rank, WARMUP, TRIALS))),
+				Table::format(summarize(run_trials(select, WARMUP, TRIALS))) + (wrong? " WRONG": "")});
+	}
+	
+	printf("rank/select with %s in words, dependent random queries, median [95%% confidence interval] of %d trials\n\n",
+			tier, TRIALS);
+	table.print();
+}
+
+static void usage()
+{
+	const char* PROGRAM = "popcount";
+	
+	printf("Usage: %s [-t threads] [-c | file]\n", PROGRAM);
+	printf(R"(
+  -c         : Cross-check every method against a bit-by-bit reference on the threads,
+               it exits with -3 if any disagrees.
+  -t threads : Count the file with 1 up to so many threads, it's the hardware concurrency by default.
+  file       : Count set bits of the file, it's memory-mapped and counted in page-aligned chunks.
+               Without a file, the popcount methods are benchmarked.
+)");
+}
+
+/*
+ * Count set bits of a file, then report GB/s as the threads scale from 1 to @p maxThreads.
+ */
+static int count_file(const char* path, unsigned maxThreads)
+{
+	std::unique_ptr<MappedFile> file;
+	try
+	{
+		file.reset(new MappedFile(path));
+	}
+	catch(const std::runtime_error& error)
+	{
+		fprintf(stderr, "%s\n", error.what());
+		return -2;
+	}
+	
+	// the first pass faults the pages in, it's timed but not part of the scaling.
+	ThreadPool firstPool(maxThreads);
+	auto start = std::chrono::steady_clock::now();
+	const uint64_t count = parallel_popcount(file->data(), file->size(), firstPool);
+	auto stop = std::chrono::steady_clock::now();
+	const double firstSeconds = std::chrono::duration<double>(stop - start).count();
+	printf("%s: %llu bits set of %llu bytes\n", path, static_cast<unsigned long long>(count),
+			static_cast<unsigned long long>(file->size()));
+	if(file->size() == 0)
+		return 0;
+	printf("first pass: %.3f s, %.2f GB/s with %u threads\n\n", firstSeconds,
+			file->size() / firstSeconds / 1e9, firstPool.size());
+	
+	constexpr int WARMUP = 1, TRIALS = 5;
+	std::vector<unsigned> threadCounts;
+	for(unsigned t = 1; t < maxThreads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(maxThreads);
+	
+	Table table({"threads", "GB/s", "speedup"});
+	double single = 0;
+	bool wrong = false;
+	for(const unsigned& threads: threadCounts)
+	{
+		ThreadPool pool(threads);
+		auto trial = [&]() -> double
+		{
+			auto start = std::chrono::steady_clock::now();
+			const uint64_t result = parallel_popcount(file->data(), file->size(), pool);
+			auto stop = std::chrono::steady_clock::now();
+			
+			wrong |= result != count;
+			return file->size() / std::chrono::duration<double>(stop - start).count() / 1e9;
+		};
+		
+		const Summary summary = summarize(run_trials(trial, WARMUP, TRIALS));
+		if(threads == 1)
+			single = summary.median;
+		char speedup[32];
+		snprintf(speedup, sizeof(speedup), "%.2fx", summary.median / single);
+		table.add_row({std::to_string(threads), Table::format(summary), speedup});
+	}
+	
+	printf("scaling over threads, median [95%% confidence interval] of %d trials\n\n", TRIALS);
+	table.print();
+	if(wrong)  // threads must agree with the first pass.
+	{
+		fprintf(stderr, "the counts of the passes differ\n");
+		return -3;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned maxThreads = std::max(1U, std::thread::hardware_concurrency());
+	bool check = false;
+	for(; argc > 1 && argv[1][0] == '-'; --argc, ++argv)
+	{
+		if(std::strcmp(argv[1], "-c") == 0)
+			check = true;
+		else if(std::strcmp(argv[1], "-t") == 0 && argc > 2)
+		{
+			maxThreads = static_cast<unsigned>(std::max(1, std::atoi(argv[2])));
+			--argc;
+			++argv;
+		}
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	
+	if(argc > 2 || (check && argc == 2))
+	{
+		usage();
+		return -1;
+	}
+	if(argc == 2)
+		return count_file(argv[1], maxThreads);
+	
+	printf("CPU features: %s\n\n", describe(cpu_features()).c_str());
+	if(check)
+	{
+		ThreadPool pool(maxThreads);
+		return cross_check(pool) ? 0 : -3;
+	}
+	
+	
+	benchmark_scalar(SCALAR_THROUGHPUT);
+	printf("\n");
+	benchmark_scalar(SCALAR_LATENCY);
+	printf("\n");
+	benchmark_buffer();
+	printf("\n");
+	benchmark_cache_pressure();
+	printf("\n");
+	benchmark_positional();
+	printf("\n");
+	benchmark_pair();
+	printf("\n");
+	benchmark_hamming();
+	printf("\n");
+	benchmark_rank_select();
+	return 0;
+}
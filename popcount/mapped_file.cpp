@@ -0,0 +1,91 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#else
+#define HAS_MMAP 0
+#endif
+
+static std::runtime_error file_error(const std::string& path, const char* action)
+{
+	return std::runtime_error("can't " + std::string(action) + " " + path + ": " + std::strerror(errno));
+}
+
+MappedFile::MappedFile(const std::string& path) noexcept(false):
+		bytes(nullptr),
+		length(0),
+		mapped(false)
+{
+#if HAS_MMAP
+	const int descriptor = open(path.c_str(), O_RDONLY);
+	if(descriptor < 0)
+		throw file_error(path, "open");
+
+	struct stat status;
+	if(fstat(descriptor, &status) != 0)
+	{
+		const std::runtime_error error = file_error(path, "stat");
+		close(descriptor);
+		throw error;
+	}
+
+	length = static_cast<size_t>(status.st_size);
+	if(length > 0)  // mmap rejects an empty mapping.
+	{
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if(address == MAP_FAILED)
+		{
+			const std::runtime_error error = file_error(path, "map");
+			close(descriptor);
+			throw error;
+		}
+		bytes = static_cast<const uint8_t*>(address);
+		mapped = true;
+	}
+	close(descriptor);  // the mapping holds its own reference to the file.
+
+#else
+	FILE* file = fopen(path.c_str(), "rb");
+	if(file == nullptr)
+		throw file_error(path, "open");
+
+	uint8_t chunk[1 << 16];
+	size_t n;
+	while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		buffer.insert(buffer.end(), chunk, chunk + n);
+	const bool failed = ferror(file) != 0;
+	fclose(file);
+	if(failed)
+		throw file_error(path, "read");
+
+	length = buffer.size();
+	bytes = buffer.empty()? nullptr: buffer.data();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if HAS_MMAP
+	if(mapped)
+		munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+}
+
+const uint8_t* MappedFile::data() const
+{
+	return bytes;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
@@ -0,0 +1,38 @@
+#ifndef GITHUB_KALO2_POPCOUNT_MAPPED_FILE_
+#define GITHUB_KALO2_POPCOUNT_MAPPED_FILE_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A read-only file in memory. On POSIX systems it's mapped with mmap, so pages are read on demand
+ * and shared with the page cache. Elsewhere the file is read into a buffer.
+ */
+class MappedFile
+{
+private:
+	const uint8_t* bytes;
+	size_t length;
+	bool mapped;
+	std::vector<uint8_t> buffer;  // the content if the file isn't mapped.
+
+public:
+	/**
+	 * @throw std::runtime_error if the file can't be opened or mapped.
+	 */
+	explicit MappedFile(const std::string& path) noexcept(false);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * @return the first byte, it's page aligned if mapped. nullptr if the file is empty.
+	 */
+	const uint8_t* data() const;
+	size_t size() const;
+};
+
+#endif  // GITHUB_KALO2_POPCOUNT_MAPPED_FILE_
@@ -0,0 +1,71 @@
+#include "methods.h"
+
+#define ELEMENT(n, f) {(n), #n, (f)}
+
+const std::vector<Method<FUNC_POPCNT>> SCALAR_METHOD =
+{
+	ELEMENT(iterated_popcnt, nullptr),
+	ELEMENT(  sparse_popcnt, nullptr),
+	ELEMENT(   dense_popcnt, nullptr),
+	ELEMENT(  lookup_popcnt, nullptr),
+	ELEMENT(lookup11_popcnt, nullptr),
+	ELEMENT(lookup16_popcnt, nullptr),
+	ELEMENT(parallel_popcnt, nullptr),
+	ELEMENT(   nifty_popcnt, nullptr),
+	ELEMENT(  hacker_popcnt, nullptr),
+	ELEMENT(  hakmem_popcnt, nullptr),
+	ELEMENT(hardware_popcnt, &CpuFeatures::popcnt),
+};
+
+const std::vector<Method<FUNC_POPCNT_BUFFER>> BUFFER_METHOD =
+{
+	ELEMENT(     hacker_popcnt_buffer, nullptr),
+	ELEMENT(     lookup_popcnt_buffer, nullptr),
+	ELEMENT(harley_seal_popcnt_buffer, nullptr),
+	ELEMENT(   hardware_popcnt_buffer, &CpuFeatures::popcnt),
+	ELEMENT(       avx2_popcnt_buffer, &CpuFeatures::avx2),
+	ELEMENT(     avx512_popcnt_buffer, &CpuFeatures::avx512_vpopcntdq),
+	ELEMENT(avx2_gather_popcnt_buffer, &CpuFeatures::avx2),
+	ELEMENT(          popcount_buffer, nullptr),
+#if POPCOUNT_ISA_VARIANTS
+	ELEMENT(     x86_64_popcnt_buffer, nullptr),
+	ELEMENT(  x86_64_v2_popcnt_buffer, &CpuFeatures::x86_64_v2),
+	ELEMENT(  x86_64_v3_popcnt_buffer, &CpuFeatures::x86_64_v3),
+	ELEMENT(  x86_64_v4_popcnt_buffer, &CpuFeatures::x86_64_v4),
+	ELEMENT(      isa_popcount_buffer, nullptr),
+#endif
+};
+
+const std::vector<Method<FUNC_POSITIONAL_POPCNT>> POSITIONAL_METHOD =
+{
+	ELEMENT(   iterated_positional_popcnt, nullptr),
+	ELEMENT(harley_seal_positional_popcnt, nullptr),
+	ELEMENT(       avx2_positional_popcnt, &CpuFeatures::avx2),
+	ELEMENT(          positional_popcount, nullptr),
+};
+
+#undef ELEMENT
+
+#define ELEMENT(n, o, f) {(n), #n, (o), (f)}
+
+const std::vector<PairMethod> PAIR_METHOD =
+{
+	ELEMENT(harley_seal_popcnt_and,    BIT_AND,    nullptr),
+	ELEMENT(harley_seal_popcnt_or,     BIT_OR,     nullptr),
+	ELEMENT(harley_seal_popcnt_xor,    BIT_XOR,    nullptr),
+	ELEMENT(harley_seal_popcnt_andnot, BIT_ANDNOT, nullptr),
+	ELEMENT(       avx2_popcnt_and,    BIT_AND,    &CpuFeatures::avx2),
+	ELEMENT(       avx2_popcnt_or,     BIT_OR,     &CpuFeatures::avx2),
+	ELEMENT(       avx2_popcnt_xor,    BIT_XOR,    &CpuFeatures::avx2),
+	ELEMENT(       avx2_popcnt_andnot, BIT_ANDNOT, &CpuFeatures::avx2),
+	ELEMENT(     avx512_popcnt_and,    BIT_AND,    &CpuFeatures::avx512_vpopcntdq),
+	ELEMENT(     avx512_popcnt_or,     BIT_OR,     &CpuFeatures::avx512_vpopcntdq),
+	ELEMENT(     avx512_popcnt_xor,    BIT_XOR,    &CpuFeatures::avx512_vpopcntdq),
+	ELEMENT(     avx512_popcnt_andnot, BIT_ANDNOT, &CpuFeatures::avx512_vpopcntdq),
+	ELEMENT(          popcount_and,    BIT_AND,    nullptr),
+	ELEMENT(          popcount_or,     BIT_OR,     nullptr),
+	ELEMENT(          popcount_xor,    BIT_XOR,    nullptr),
+	ELEMENT(          popcount_andnot, BIT_ANDNOT, nullptr),
+};
+
+#undef ELEMENT
@@ -0,0 +1,44 @@
+#ifndef GITHUB_KALO2_POPCOUNT_METHODS_
+#define GITHUB_KALO2_POPCOUNT_METHODS_
+
+#include <vector>
+
+#include "cpu_features.h"
+#include "popcount.h"
+
+/**
+ * A popcount function, its name and the CPU feature it needs. The benchmark measures them and the
+ * cross-check verifies them, so a new method is added to both by adding it here.
+ */
+template <typename Function>
+struct Method
+{
+	Function pfunc;
+	const char* name;
+	bool CpuFeatures::* feature;  ///< nullptr if every CPU runs it.
+
+	bool supported() const
+	{
+		return feature == nullptr || cpu_features().*feature;
+	}
+};
+
+struct PairMethod
+{
+	FUNC_POPCNT_PAIR pfunc;
+	const char* name;
+	BitOperation operation;
+	bool CpuFeatures::* feature;
+
+	bool supported() const
+	{
+		return feature == nullptr || cpu_features().*feature;
+	}
+};
+
+extern const std::vector<Method<FUNC_POPCNT>> SCALAR_METHOD;
+extern const std::vector<Method<FUNC_POPCNT_BUFFER>> BUFFER_METHOD;
+extern const std::vector<Method<FUNC_POSITIONAL_POPCNT>> POSITIONAL_METHOD;
+extern const std::vector<PairMethod> PAIR_METHOD;
+
+#endif  // GITHUB_KALO2_POPCOUNT_METHODS_
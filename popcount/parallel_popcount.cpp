@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <vector>
+
+#include "parallel_popcount.h"
+#include "popcount.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+static size_t page_size()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	const long size = sysconf(_SC_PAGESIZE);
+	if(size > 0)
+		return static_cast<size_t>(size);
+#endif
+	return 4096;
+}
+
+uint64_t parallel_popcount(const void* buffer, size_t size, ThreadPool& pool, size_t chunkSize)
+{
+	const size_t page = page_size();
+	chunkSize = std::max(page, (chunkSize + page - 1) / page * page);
+	const size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+
+	// each thread adds to its sum once per chunk of pages, too rarely for sharing a cache line to matter.
+	std::vector<uint64_t> sums(pool.size(), 0);
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+	pool.run(chunkCount, [&](size_t chunk, unsigned thread)
+	{
+		const size_t offset = chunk * chunkSize;
+		sums[thread] += popcount_buffer(bytes + offset, std::min(chunkSize, size - offset));
+	});
+
+	uint64_t total = 0;
+	for(uint64_t sum: sums)
+		total += sum;
+	return total;
+}
@@ -0,0 +1,16 @@
+#ifndef GITHUB_KALO2_POPCOUNT_PARALLEL_
+#define GITHUB_KALO2_POPCOUNT_PARALLEL_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "thread_pool.h"
+
+/**
+ * Count set bits of a buffer on the threads of @p pool. The buffer is cut into chunks of
+ * @p chunkSize bytes, rounded up to whole pages, so two threads never fault the same page of a
+ * mapped file. Each chunk is counted with popcount_buffer().
+ */
+uint64_t parallel_popcount(const void* buffer, size_t size, ThreadPool& pool, size_t chunkSize = size_t(4) << 20);
+
+#endif  // GITHUB_KALO2_POPCOUNT_PARALLEL_
@@ -1,8 +1,16 @@
-#include <cstdio>
+#include <atomic>
 #include <climits>
 #include <cstdint>
 #include <cassert>
-#include <ctime>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "cpu_features.h"
+#include "popcount.h"
+#include "popcount_constexpr.h"
 
 int iterated_popcnt(uint32_t n)
 {
@@ -35,50 +43,42 @@ int dense_popcnt(uint32_t n)
 	return count;
 }
 
-#ifdef USE_MACRO
+// The templates are checked by the compiler, in every width and policy.
+static_assert(popcount_byte(0xB7) == 6, "byte table");
+static_assert(popcount<uint8_t, ParallelPolicy>(0xFF) == 8 && popcount<uint8_t, LookupPolicy>(0x81) == 2, "8-bit");
+static_assert(popcount<uint16_t, HackerPolicy>(0xF00F) == 8 && popcount<uint16_t, ParallelPolicy>(0xFFFF) == 16, "16-bit");
+static_assert(popcount<uint32_t, ParallelPolicy>(0xFFFFFFFFU) == 32 && popcount<uint32_t, LookupPolicy>(0x80000001U) == 2, "32-bit");
+static_assert(popcount<uint64_t, HackerPolicy>(~0ULL) == 64 && popcount<uint64_t, ParallelPolicy>(0x8000000000000001ULL) == 2, "64-bit");
+static_assert(popcount<uint64_t, LookupPolicy>(0x0123456789ABCDEFULL) == 32, "64-bit");
+#if defined(__SIZEOF_INT128__)
+static_assert(popcount<unsigned __int128, HackerPolicy>(~static_cast<unsigned __int128>(0)) == 128, "128-bit");
+static_assert(popcount<unsigned __int128, ParallelPolicy>(static_cast<unsigned __int128>(~0ULL) << 64) == 64, "128-bit");
+static_assert(popcount<unsigned __int128, LookupPolicy>(static_cast<unsigned __int128>(1) << 127 | 1) == 2, "128-bit");
+#endif
 
 int lookup_popcnt(uint32_t n)
 {
-# define BIT2(n)      n,       n+1,       n+1,       n+2
-# define BIT4(n) BIT2(n), BIT2(n+1), BIT2(n+1), BIT2(n+2)
-# define BIT6(n) BIT4(n), BIT4(n+1), BIT4(n+1), BIT4(n+2)
-# define BIT8(n) BIT6(n), BIT6(n+1), BIT6(n+1), BIT6(n+2)
-
-	static_assert(CHAR_BIT == 8);
-	static const uint8_t table[256] = { BIT8(0) };
-
-	return 
-		table[(n    ) & 0xFF] +
-		table[(n>> 8) & 0xFF] +
-		table[(n>>16) & 0xFF] +
-		table[(n>>24) & 0xFF];
+	return popcount<uint32_t, LookupPolicy>(n);
 }
 
-#else
-static constexpr size_t TBL_LEN = 1U << CHAR_BIT;
-static uint8_t table[TBL_LEN] = {0};
-
-int lookup_popcnt(uint32_t n)
+/*
+ * Wider tables take fewer lookups, but 2KB or 64KB of table compete with the data for L1 cache.
+ */
+int lookup11_popcnt(uint32_t n)
 {
-	uint8_t *p = reinterpret_cast<uint8_t*>(&n);
-	return table[p[0]] + table[p[1]] + table[p[2]] + table[p[3]];
+	const uint8_t* table = popcount_detail::Lookup<11>::TABLE.count;
+	return table[n & 0x7FF] + table[(n >> 11) & 0x7FF] + table[n >> 22];
 }
 
-#endif  // USE_MACRO
-
-#define POW2(c)    (1u << (c))
-#define MASK(c)    (UINT_MAX / (POW2(POW2(c)) + 1u))
-#define COUNT(x, c) (((x) & MASK(c)) + (((x)>>POW2(c)) & MASK(c)))
+int lookup16_popcnt(uint32_t n)
+{
+	const uint8_t* table = popcount_detail::Lookup<16>::TABLE.count;
+	return table[n & 0xFFFF] + table[n >> 16];
+}
 
 int parallel_popcnt(uint32_t n)
 {
-	n = COUNT(n, 0);
-	n = COUNT(n, 1);
-	n = COUNT(n, 2);
-	n = COUNT(n, 3);
-	n = COUNT(n, 4);
-//  n = COUNT(n, 5);  // uncomment this line for 64-bit integers
-	return n;
+	return popcount<uint32_t, ParallelPolicy>(n);
 }
 
 #define MASK_01010101 (((unsigned int)(-1))/3)
@@ -95,12 +95,12 @@ int nifty_popcnt(uint32_t n)
 
 int hacker_popcnt(uint32_t n)
 {
-	n -= (n>>1) & 0x55555555;
-	n  = (n & 0x33333333) + ((n>>2) & 0x33333333);
-	n  = ((n>>4) + n) & 0x0F0F0F0F;
-	n += n>>8;
-	n += n>>16;
-	return n & 0x0000003F;
+	return popcount<uint32_t, HackerPolicy>(n);
+}
+
+int hacker_popcnt64(uint64_t n)
+{
+	return popcount<uint64_t, HackerPolicy>(n);
 }
 
 /*
@@ -137,76 +137,248 @@ int hakmem_popcnt(uint32_t n)
 	return ((tmp+(tmp>>3)) & 030707070707) % 63;
 }
 
-int assembly_popcnt(uint32_t n)
-{
 /*
-	asm("popcnt %0,%%eax"::"r"(n));  // Intel style
-	__asm popcnt eax,n;              // AT&T style
-	
-	The two instructions above are functionally equivalent, and both will 
-	generate warning "no return statement" if you enable all the warnings.
-	A caveat applies here: Don't clobber your registers!
-
-	What, unfamiliar with inline assembly code?
-	It's time to get your hands dirty.
-	http://msdn.microsoft.com/en-us/library/4ks26t93(v=vs.110).aspx
-	http://www.ibiblio.org/gferg/ldp/GCC-Inline-Assembly-HOWTO.html
+	The compiler emits POPCNT for the builtin inside a function targeting it. Unlike inline
+	assembly, the compiler knows what the instruction does, so it can schedule and fold it.
+	Other functions of this file are compiled for the baseline ISA and run on every CPU.
 */
-#ifdef _MSC_VER  // use Intel style assembly
-	__asm popcnt eax,n;
-//	The function does return a value in EAX
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define TARGET_POPCNT __attribute__((target("popcnt")))
+#	define HARDWARE_POPCNT(n) __builtin_popcount(n)
+#	define HARDWARE_POPCNT64(n) __builtin_popcountll(n)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#	define TARGET_POPCNT
+#	define HARDWARE_POPCNT(n) __popcnt(n)
+#	define HARDWARE_POPCNT64(n) __popcnt64(n)
+#else  // no such instruction, it's just the fallback.
+#	define TARGET_POPCNT
+#	define HARDWARE_POPCNT(n) hacker_popcnt(n)
+#	define HARDWARE_POPCNT64(n) hacker_popcnt64(n)
+#endif
 
-#elif __GNUC__  // use AT&T style assembly
-	register int result; // Hey, it's my first time to use the keyword register!
-	asm("popcnt %1,%0":"=r"(result):"r"(n)); // probably generates "popcnt eax,eax"
-	return result;
+TARGET_POPCNT
+int hardware_popcnt(uint32_t n)
+{
+	return HARDWARE_POPCNT(n);
+}
 
-#else
-#	error "other POPCNT implementations go here"
-#endif
+TARGET_POPCNT
+int hardware_popcnt64(uint64_t n)
+{
+	return static_cast<int>(HARDWARE_POPCNT64(n));
 }
 
-int main()
+/*
+	Buffers are read a 64-bit word at a time. memcpy makes an unaligned load well defined, and
+	compilers turn it into a plain mov. The bytes after the last whole word are zero-extended.
+*/
+static inline uint64_t load_word(const uint8_t* p)
 {
-#if !defined(USE_MACRO)
-	// generate the table algorithmically
-	for(size_t i = 1; i < TBL_LEN; ++i)
-		table[i] = table[i>>1] + (i&1);
-#endif
+	uint64_t word;
+	std::memcpy(&word, p, sizeof(word));
+	return word;
+}
 
-	typedef int (*FUNC_POPCNT)(uint32_t);
+static inline uint64_t load_tail(const uint8_t* p, size_t size)
+{
+	uint64_t word = 0;
+	std::memcpy(&word, p, size);
+	return word;
+}
 
-	const struct Pair
-	{
-		FUNC_POPCNT pfunc;
-		const char* name;
-	} METHOD[] =
+uint64_t hacker_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	uint64_t count = 0;
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+		count += hacker_popcnt64(load_word(p + i));
+	if(i < size)
+		count += hacker_popcnt64(load_tail(p + i, size - i));
+	return count;
+}
+
+/*
+	POPCNT takes 3 cycles of latency and issues one per cycle, a single accumulator would make
+	every instruction wait for the previous add. Four independent sums keep the unit busy.
+*/
+TARGET_POPCNT
+uint64_t hardware_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	uint64_t count0 = 0, count1 = 0, count2 = 0, count3 = 0;
+	size_t i = 0;
+	for(; i + 4 * sizeof(uint64_t) <= size; i += 4 * sizeof(uint64_t))
 	{
-#define ELEMENT(n) {(n), #n}
-		ELEMENT(iterated_popcnt),
-		ELEMENT(  sparse_popcnt),
-		ELEMENT(   dense_popcnt),
-		ELEMENT(  lookup_popcnt),
-		ELEMENT(parallel_popcnt),
-		ELEMENT(   nifty_popcnt),
-		ELEMENT(  hacker_popcnt),
-		ELEMENT(  hakmem_popcnt),
-		ELEMENT(assembly_popcnt)
-#undef ELEMENT
-	};
-	
-	constexpr size_t methodCount = sizeof(METHOD) / sizeof(METHOD[0]);
-	for(size_t i = 0; i < methodCount; ++i)
+		count0 += HARDWARE_POPCNT64(load_word(p + i));
+		count1 += HARDWARE_POPCNT64(load_word(p + i +  8));
+		count2 += HARDWARE_POPCNT64(load_word(p + i + 16));
+		count3 += HARDWARE_POPCNT64(load_word(p + i + 24));
+	}
+	for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+		count0 += HARDWARE_POPCNT64(load_word(p + i));
+	if(i < size)
+		count0 += HARDWARE_POPCNT64(load_tail(p + i, size - i));
+	return count0 + count1 + count2 + count3;
+}
+
+uint64_t lookup_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	uint64_t count0 = 0, count1 = 0, count2 = 0, count3 = 0;
+	size_t i = 0;
+	for(; i + 4 <= size; i += 4)
 	{
-		std::time_t start = std::clock();
-		const uint32_t N = 0x10000000;  // 0xDEADBEAF, can be tweaked
-		for(uint32_t j = 0; j < N; ++j)
-			METHOD[i].pfunc(j);
-
-		std::time_t stop = std::clock();
-		double time = static_cast<double>(stop - start) / CLOCKS_PER_SEC / N;
-		printf("%zu. method %15s uses %Gs\n", i, METHOD[i].name, time);
+		count0 += popcount_byte(p[i    ]);
+		count1 += popcount_byte(p[i + 1]);
+		count2 += popcount_byte(p[i + 2]);
+		count3 += popcount_byte(p[i + 3]);
 	}
-	
-	return 0;
+	for(; i < size; ++i)
+		count0 += popcount_byte(p[i]);
+	return count0 + count1 + count2 + count3;
+}
+
+FUNC_POPCNT_BUFFER select_popcnt_buffer(const CpuFeatures& features)
+{
+	if(features.avx512_vpopcntdq)
+		return avx512_popcnt_buffer;
+	if(features.avx2)
+		return avx2_popcnt_buffer;
+	if(features.popcnt)
+		return hardware_popcnt_buffer;
+	return harley_seal_popcnt_buffer;
+}
+
+/*
+	Like a GNU ifunc, the pointer starts at a resolver. The first call detects the CPU, binds the
+	pointer to the chosen back end and forwards to it, later calls go to the back end directly.
+	Racing threads store the same value, relaxed atomics make that well defined.
+*/
+static uint64_t resolve_popcnt_buffer(const void* buffer, size_t size);
+
+static std::atomic<FUNC_POPCNT_BUFFER> popcnt_buffer_pointer(resolve_popcnt_buffer);
+
+static uint64_t resolve_popcnt_buffer(const void* buffer, size_t size)
+{
+	const FUNC_POPCNT_BUFFER pfunc = select_popcnt_buffer(cpu_features());
+	popcnt_buffer_pointer.store(pfunc, std::memory_order_relaxed);
+	return pfunc(buffer, size);
+}
+
+uint64_t popcount_buffer(const void* buffer, size_t size)
+{
+	return popcnt_buffer_pointer.load(std::memory_order_relaxed)(buffer, size);
+}
+
+#if POPCOUNT_ISA_VARIANTS
+FUNC_POPCNT_BUFFER select_isa_popcnt_buffer(const CpuFeatures& features)
+{
+	if(features.x86_64_v4)
+		return x86_64_v4_popcnt_buffer;
+	if(features.x86_64_v3)
+		return x86_64_v3_popcnt_buffer;
+	if(features.x86_64_v2)
+		return x86_64_v2_popcnt_buffer;
+	return x86_64_popcnt_buffer;
+}
+
+static uint64_t resolve_isa_popcnt_buffer(const void* buffer, size_t size);
+
+static std::atomic<FUNC_POPCNT_BUFFER> isa_popcnt_buffer_pointer(resolve_isa_popcnt_buffer);
+
+static uint64_t resolve_isa_popcnt_buffer(const void* buffer, size_t size)
+{
+	const FUNC_POPCNT_BUFFER pfunc = select_isa_popcnt_buffer(cpu_features());
+	isa_popcnt_buffer_pointer.store(pfunc, std::memory_order_relaxed);
+	return pfunc(buffer, size);
+}
+
+uint64_t isa_popcount_buffer(const void* buffer, size_t size)
+{
+	return isa_popcnt_buffer_pointer.load(std::memory_order_relaxed)(buffer, size);
+}
+#endif
+
+void iterated_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	for(size_t i = 0; i < count; ++i)
+		for(int b = 0; b < 64; ++b)
+			counts[b] += (words[i] >> b) & 1;
+}
+
+FUNC_POSITIONAL_POPCNT select_positional_popcnt(const CpuFeatures& features)
+{
+	return features.avx2? avx2_positional_popcnt: harley_seal_positional_popcnt;
+}
+
+static void resolve_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64]);
+
+static std::atomic<FUNC_POSITIONAL_POPCNT> positional_popcnt_pointer(resolve_positional_popcnt);
+
+static void resolve_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	const FUNC_POSITIONAL_POPCNT pfunc = select_positional_popcnt(cpu_features());
+	positional_popcnt_pointer.store(pfunc, std::memory_order_relaxed);
+	pfunc(words, count, counts);
+}
+
+void positional_popcount(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	positional_popcnt_pointer.load(std::memory_order_relaxed)(words, count, counts);
+}
+
+FUNC_POPCNT_PAIR select_popcnt_pair(BitOperation operation, const CpuFeatures& features)
+{
+	static const FUNC_POPCNT_PAIR AVX512[BIT_OPERATION_COUNT] =
+			{avx512_popcnt_and, avx512_popcnt_or, avx512_popcnt_xor, avx512_popcnt_andnot};
+	static const FUNC_POPCNT_PAIR AVX2[BIT_OPERATION_COUNT] =
+			{avx2_popcnt_and, avx2_popcnt_or, avx2_popcnt_xor, avx2_popcnt_andnot};
+	static const FUNC_POPCNT_PAIR HARLEY_SEAL[BIT_OPERATION_COUNT] =
+			{harley_seal_popcnt_and, harley_seal_popcnt_or, harley_seal_popcnt_xor, harley_seal_popcnt_andnot};
+
+	if(features.avx512_vpopcntdq)
+		return AVX512[operation];
+	if(features.avx2)
+		return AVX2[operation];
+	return HARLEY_SEAL[operation];
+}
+
+template <BitOperation OPERATION>
+static uint64_t resolve_popcnt_pair(const uint64_t* a, const uint64_t* b, size_t count);
+
+static std::atomic<FUNC_POPCNT_PAIR> popcnt_pair_pointer[BIT_OPERATION_COUNT] =
+{
+	{resolve_popcnt_pair<BIT_AND>},
+	{resolve_popcnt_pair<BIT_OR>},
+	{resolve_popcnt_pair<BIT_XOR>},
+	{resolve_popcnt_pair<BIT_ANDNOT>},
+};
+
+template <BitOperation OPERATION>
+static uint64_t resolve_popcnt_pair(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	const FUNC_POPCNT_PAIR pfunc = select_popcnt_pair(OPERATION, cpu_features());
+	popcnt_pair_pointer[OPERATION].store(pfunc, std::memory_order_relaxed);
+	return pfunc(a, b, count);
+}
+
+uint64_t popcount_and(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return popcnt_pair_pointer[BIT_AND].load(std::memory_order_relaxed)(a, b, count);
+}
+
+uint64_t popcount_or(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return popcnt_pair_pointer[BIT_OR].load(std::memory_order_relaxed)(a, b, count);
+}
+
+uint64_t popcount_xor(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return popcnt_pair_pointer[BIT_XOR].load(std::memory_order_relaxed)(a, b, count);
+}
+
+uint64_t popcount_andnot(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return popcnt_pair_pointer[BIT_ANDNOT].load(std::memory_order_relaxed)(a, b, count);
 }
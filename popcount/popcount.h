@@ -0,0 +1,151 @@
+#ifndef GITHUB_KALO2_POPCOUNT_
+#define GITHUB_KALO2_POPCOUNT_
+
+#include <cstddef>
+#include <cstdint>
+
+struct CpuFeatures;
+
+/*
+	Population count, namely the number of set bits, of one integer.
+	They give the same result, but the speed varies with the input and the CPU.
+	The tables of the lookup methods are built at compile time, see popcount_constexpr.h.
+*/
+typedef int (*FUNC_POPCNT)(uint32_t n);
+
+int iterated_popcnt(uint32_t n);
+int   sparse_popcnt(uint32_t n);  // fast when few bits are set.
+int    dense_popcnt(uint32_t n);  // fast when most bits are set.
+int   lookup_popcnt(uint32_t n);  // 4 lookups in a 256-byte table.
+int lookup11_popcnt(uint32_t n);  // 3 lookups in a 2KB table of 11-bit integers.
+int lookup16_popcnt(uint32_t n);  // 2 lookups in a 64KB table of 16-bit integers.
+int parallel_popcnt(uint32_t n);
+int    nifty_popcnt(uint32_t n);
+int   hacker_popcnt(uint32_t n);
+int   hakmem_popcnt(uint32_t n);
+
+int hacker_popcnt64(uint64_t n);
+
+/*
+	POPCNT instruction through __builtin_popcount, the CPU must support it.
+	Check cpu_features().popcnt before calling them, or the program dies of SIGILL.
+*/
+int hardware_popcnt(uint32_t n);
+int hardware_popcnt64(uint64_t n);
+
+/*
+	Population count of a buffer, which needn't be aligned.
+	Each back end counts @p size bytes at @p buffer.
+*/
+typedef uint64_t (*FUNC_POPCNT_BUFFER)(const void* buffer, size_t size);
+
+uint64_t   hacker_popcnt_buffer(const void* buffer, size_t size);  // hacker_popcnt64 word by word.
+uint64_t hardware_popcnt_buffer(const void* buffer, size_t size);  // POPCNT instruction, 4 accumulators.
+uint64_t   lookup_popcnt_buffer(const void* buffer, size_t size);  // table lookup byte by byte.
+
+/*
+	Harley-Seal carry-save adders, only 1 of 16 words gets a real popcount.
+	The SIMD back ends need the CPU to support the instructions, check it with cpu_features().
+*/
+uint64_t harley_seal_popcnt_buffer(const void* buffer, size_t size);  // portable, 64-bit words.
+uint64_t        avx2_popcnt_buffer(const void* buffer, size_t size);  // AVX2, nibble lookup with pshufb.
+uint64_t      avx512_popcnt_buffer(const void* buffer, size_t size);  // AVX-512 VPOPCNTDQ.
+
+/*
+	Byte-sliced lookup with AVX2 gathers, each byte of a vector indexes a 256-entry table in memory.
+	It's slower than the pshufb nibble lookup, whose table lives in a register, it's there to
+	measure table methods in SIMD form.
+*/
+uint64_t avx2_gather_popcnt_buffer(const void* buffer, size_t size);
+
+/**
+ * @return the fastest back end that runs on a CPU with @p features.
+ */
+FUNC_POPCNT_BUFFER select_popcnt_buffer(const CpuFeatures& features);
+
+/**
+ * Count set bits of a buffer with the fastest back end of the running CPU, it's bound on the first
+ * call and the dispatch costs one indirect call after that.
+ */
+uint64_t popcount_buffer(const void* buffer, size_t size);
+
+#if POPCOUNT_ISA_VARIANTS
+/*
+	A portable kernel that the build compiles once per x86-64 level, see popcount_isa.cpp. The
+	compiler vectorizes it with SSE2, SSE4.2, AVX2 and AVX-512 in turn, so the levels show what
+	-march alone is worth. Check cpu_features() for the level before calling one.
+*/
+uint64_t    x86_64_popcnt_buffer(const void* buffer, size_t size);
+uint64_t x86_64_v2_popcnt_buffer(const void* buffer, size_t size);
+uint64_t x86_64_v3_popcnt_buffer(const void* buffer, size_t size);
+uint64_t x86_64_v4_popcnt_buffer(const void* buffer, size_t size);
+
+FUNC_POPCNT_BUFFER select_isa_popcnt_buffer(const CpuFeatures& features);
+
+/**
+ * Count set bits of a buffer with the highest level the running CPU supports, it's bound on the
+ * first call.
+ */
+uint64_t isa_popcount_buffer(const void* buffer, size_t size);
+#endif
+
+/*
+	Population count of an operation of two bitmaps, e.g. |a & b| for the Jaccard index or
+	|a ^ b| for the Hamming distance. The operation is fused into the count, so its result is never
+	written to memory. Both bitmaps have @p count words.
+*/
+enum BitOperation
+{
+	BIT_AND,
+	BIT_OR,
+	BIT_XOR,
+	BIT_ANDNOT,  ///< a & ~b.
+
+	BIT_OPERATION_COUNT,
+};
+
+typedef uint64_t (*FUNC_POPCNT_PAIR)(const uint64_t* a, const uint64_t* b, size_t count);
+
+uint64_t harley_seal_popcnt_and   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t harley_seal_popcnt_or    (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t harley_seal_popcnt_xor   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t harley_seal_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count);
+
+uint64_t        avx2_popcnt_and   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t        avx2_popcnt_or    (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t        avx2_popcnt_xor   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t        avx2_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count);
+
+uint64_t      avx512_popcnt_and   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t      avx512_popcnt_or    (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t      avx512_popcnt_xor   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t      avx512_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count);
+
+FUNC_POPCNT_PAIR select_popcnt_pair(BitOperation operation, const CpuFeatures& features);
+
+/*
+	Fused counts with the fastest back end of the running CPU, each is bound on its first call.
+*/
+uint64_t popcount_and   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t popcount_or    (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t popcount_xor   (const uint64_t* a, const uint64_t* b, size_t count);
+uint64_t popcount_andnot(const uint64_t* a, const uint64_t* b, size_t count);
+
+/*
+	Positional population count of @p count words: counts[i] += the number of words with bit i set.
+	The counts are added to, so a large array can be counted in batches.
+*/
+typedef void (*FUNC_POSITIONAL_POPCNT)(const uint64_t* words, size_t count, uint64_t counts[64]);
+
+void    iterated_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64]);  // bit by bit.
+void harley_seal_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64]);  // CSA over 16 words.
+void        avx2_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64]);  // CSA over 64 words, AVX2.
+
+FUNC_POSITIONAL_POPCNT select_positional_popcnt(const CpuFeatures& features);
+
+/**
+ * Positional popcount with the fastest back end of the running CPU, it's bound on the first call.
+ */
+void positional_popcount(const uint64_t* words, size_t count, uint64_t counts[64]);
+
+#endif  // GITHUB_KALO2_POPCOUNT_
@@ -0,0 +1,130 @@
+#ifndef GITHUB_KALO2_POPCOUNT_CONSTEXPR_
+#define GITHUB_KALO2_POPCOUNT_CONSTEXPR_
+
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+
+/*
+	Population count of any unsigned integer as a constant expression, e.g.
+	    static_assert(popcount<uint64_t, ParallelPolicy>(~0ULL) == 64, "");
+	The policy picks the method, they give the same result.
+	unsigned __int128 works where the compiler has it.
+*/
+struct ParallelPolicy {};  ///< add bits in pairs, then nibbles, bytes and so on.
+struct HackerPolicy {};    ///< Hacker's Delight, count nibbles then sum the bytes.
+struct LookupPolicy {};    ///< a 256-entry table generated at compile time.
+
+namespace popcount_detail
+{
+
+template <typename T>
+struct IsUnsigned: std::integral_constant<bool, std::is_integral<T>::value && std::is_unsigned<T>::value> {};
+
+#if defined(__SIZEOF_INT128__)  // std::is_unsigned misses it in strict ISO mode.
+template <>
+struct IsUnsigned<unsigned __int128>: std::true_type {};
+#endif
+
+template <typename T>
+struct Traits
+{
+	static_assert(IsUnsigned<T>::value, "popcount needs an unsigned integer");
+
+	// Integers narrower than unsigned int are promoted, so the arithmetic is done in Word.
+	typedef typename std::conditional<(sizeof(T) < sizeof(unsigned)), unsigned, T>::type Word;
+
+	static constexpr int BITS = static_cast<int>(sizeof(T) * CHAR_BIT);
+	static constexpr Word ONES = static_cast<T>(~static_cast<T>(0));  // all bits of T set.
+};
+
+/*
+ * The byte @p byte repeated over the width of T.
+ */
+template <typename T>
+constexpr typename Traits<T>::Word repeat(uint8_t byte)
+{
+	return Traits<T>::ONES / 0xFF * byte;
+}
+
+/*
+ * Counts of every integer of @p BITS bits, 256 bytes for 8 bits up to 64KB for 16.
+ */
+template <int BITS>
+struct CountTable
+{
+	uint8_t count[1 << BITS];
+};
+
+template <int BITS>
+constexpr CountTable<BITS> make_count_table()
+{
+	CountTable<BITS> table = {{0}};
+	for(int i = 1; i < (1 << BITS); ++i)
+		table.count[i] = static_cast<uint8_t>(table.count[i >> 1] + (i & 1));
+	return table;
+}
+
+// A class template, so that the table can live in a header and still have one definition.
+template <int BITS = CHAR_BIT>
+struct Lookup
+{
+	static constexpr CountTable<BITS> TABLE = make_count_table<BITS>();
+};
+
+template <int BITS>
+constexpr CountTable<BITS> Lookup<BITS>::TABLE;
+
+template <typename T>
+constexpr int count(T n, ParallelPolicy)
+{
+	typedef typename Traits<T>::Word Word;
+	Word x = n;
+	for(int width = 1; width < Traits<T>::BITS; width *= 2)
+	{
+		// fields of 2 * width bits hold 0...01...1 with width ones, e.g. 0x55 for width 1.
+		const Word mask = Traits<T>::ONES / ((static_cast<Word>(1) << width) + 1);
+		x = (x & mask) + ((x >> width) & mask);
+	}
+	return static_cast<int>(x);
+}
+
+template <typename T>
+constexpr int count(T n, HackerPolicy)
+{
+	typedef typename Traits<T>::Word Word;
+	Word x = n;
+	x -= (x >> 1) & repeat<T>(0x55);
+	x  = (x & repeat<T>(0x33)) + ((x >> 2) & repeat<T>(0x33));
+	x  = ((x >> 4) + x) & repeat<T>(0x0F);
+	for(int shift = 8; shift < Traits<T>::BITS; shift *= 2)
+		x += x >> shift;
+	return static_cast<int>(x & 0xFF);  // up to 128 bits, the count fits in a byte.
+}
+
+template <typename T>
+constexpr int count(T n, LookupPolicy)
+{
+	int sum = 0;
+	for(int shift = 0; shift < Traits<T>::BITS; shift += CHAR_BIT)
+		sum += Lookup<>::TABLE.count[static_cast<uint8_t>(n >> shift)];
+	return sum;
+}
+
+}  // namespace popcount_detail
+
+template <typename T, typename Policy = HackerPolicy>
+constexpr int popcount(T n)
+{
+	return popcount_detail::count(n, Policy());
+}
+
+/**
+ * Number of set bits of byte @p n from the compile-time table.
+ */
+constexpr int popcount_byte(uint8_t n)
+{
+	return popcount_detail::Lookup<>::TABLE.count[n];
+}
+
+#endif  // GITHUB_KALO2_POPCOUNT_CONSTEXPR_
@@ -0,0 +1,47 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+	The build compiles this file once per x86-64 level, with -march of the level and POPCOUNT_ISA
+	naming the variant, e.g. -march=x86-64-v3 -DPOPCOUNT_ISA=x86_64_v3 gives
+	x86_64_v3_popcnt_buffer(). The kernel is plain C++, so its instructions are whatever the
+	compiler makes of it at each level.
+
+	Nothing here may come from a header: an inline function or template would be compiled for each
+	level, and the linker keeps one of them for every caller, which may then run instructions the
+	CPU lacks. So the count is written out as a static function.
+*/
+#if !defined(POPCOUNT_ISA)
+#error "POPCOUNT_ISA must name the variant, it's defined by the build"
+#endif
+
+#define ISA_CONCAT(isa, name) isa ## name
+#define ISA_FUNCTION(isa, name) ISA_CONCAT(isa, name)
+
+static inline uint64_t hacker_count(uint64_t x)
+{
+	x -= (x >> 1) & 0x5555555555555555ULL;
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	x += x >> 8;
+	x += x >> 16;
+	x += x >> 32;
+	return x & 0x7F;
+}
+
+uint64_t ISA_FUNCTION(POPCOUNT_ISA, _popcnt_buffer)(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	uint64_t count = 0;
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		std::memcpy(&word, p + i, sizeof(word));
+		count += hacker_count(word);
+	}
+	for(; i < size; ++i)
+		count += hacker_count(p[i]);
+	return count;
+}
@@ -0,0 +1,609 @@
+#include <algorithm>
+#include <cstring>
+
+#include "popcount.h"
+#include "popcount_constexpr.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POPCOUNT_X86 1
+#include <immintrin.h>
+#else
+#define POPCOUNT_X86 0
+#endif
+
+/*
+	Harley-Seal popcount
+
+A carry-save adder (CSA) adds three bit vectors a, b and c position by position, each position
+gives a 2-bit sum, the high bits go to h and the low bits go to l:
+    h = (a & b) | ((a ^ b) & c)
+    l = a ^ b ^ c
+so bits of weight 1 are folded into "ones", and carries of weight 2 into "twos". Feeding 16 words
+through a tree of CSAs leaves a single word of weight 16, only that word needs a real popcount. The
+counters "ones" to "eights" are counted once at the end.
+
+@see Wojciech Muła, Nathan Kurz, Daniel Lemire, Faster Population Counts Using AVX2 Instructions.
+     https://arxiv.org/abs/1611.07612
+*/
+#define CSA(h, l, a, b, c) \
+	do { const auto u = (a) ^ (b); h = ((a) & (b)) | (u & (c)); l = u ^ (c); } while(0)
+
+template <BitOperation OPERATION>
+static inline uint64_t combine64(uint64_t a, uint64_t b)
+{
+	switch(OPERATION)
+	{
+	case BIT_AND: return a & b;
+	case BIT_OR:  return a | b;
+	case BIT_XOR: return a ^ b;
+	default:      return a & ~b;
+	}
+}
+
+/*
+	The kernels are written once for a Load functor, load(k) gives word k of the input. A buffer
+	loads its words, a pair of bitmaps loads the operation of their words, so the result of the
+	operation is counted without being written to memory.
+*/
+struct BufferLoad64
+{
+	const uint8_t* p;
+
+	uint64_t operator()(size_t k) const
+	{
+		uint64_t word;
+		std::memcpy(&word, p + k * sizeof(uint64_t), sizeof(word));
+		return word;
+	}
+};
+
+template <BitOperation OPERATION>
+struct PairLoad64
+{
+	const uint64_t* a;
+	const uint64_t* b;
+
+	uint64_t operator()(size_t k) const
+	{
+		return combine64<OPERATION>(a[k], b[k]);
+	}
+};
+
+/*
+ * Harley-Seal count of words [0, @p count), the words after the last block of 16 are counted one by one.
+ */
+template <typename Load>
+static uint64_t harley_seal_count64(const Load& load, size_t count)
+{
+	uint64_t total = 0, ones = 0, twos = 0, fours = 0, eights = 0, sixteens = 0;
+	uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB;
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		CSA(twosA, ones, ones, load(i +  0), load(i +  1));
+		CSA(twosB, ones, ones, load(i +  2), load(i +  3));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, load(i +  4), load(i +  5));
+		CSA(twosB, ones, ones, load(i +  6), load(i +  7));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsA, fours, fours, foursA, foursB);
+		CSA(twosA, ones, ones, load(i +  8), load(i +  9));
+		CSA(twosB, ones, ones, load(i + 10), load(i + 11));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, load(i + 12), load(i + 13));
+		CSA(twosB, ones, ones, load(i + 14), load(i + 15));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsB, fours, fours, foursA, foursB);
+		CSA(sixteens, eights, eights, eightsA, eightsB);
+		total += hacker_popcnt64(sixteens);
+	}
+
+	total = 16 * total + 8 * hacker_popcnt64(eights) + 4 * hacker_popcnt64(fours)
+			+ 2 * hacker_popcnt64(twos) + hacker_popcnt64(ones);
+	for(; i < count; ++i)
+		total += hacker_popcnt64(load(i));
+	return total;
+}
+
+uint64_t harley_seal_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	const size_t count = size / sizeof(uint64_t);
+	const size_t offset = count * sizeof(uint64_t);
+	return harley_seal_count64(BufferLoad64{p}, count) + hacker_popcnt_buffer(p + offset, size - offset);
+}
+
+uint64_t harley_seal_popcnt_and(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return harley_seal_count64(PairLoad64<BIT_AND>{a, b}, count);
+}
+
+uint64_t harley_seal_popcnt_or(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return harley_seal_count64(PairLoad64<BIT_OR>{a, b}, count);
+}
+
+uint64_t harley_seal_popcnt_xor(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return harley_seal_count64(PairLoad64<BIT_XOR>{a, b}, count);
+}
+
+uint64_t harley_seal_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return harley_seal_count64(PairLoad64<BIT_ANDNOT>{a, b}, count);
+}
+
+/*
+ * counts[i] += weight for each bit i set in word.
+ */
+static inline void add_positions(uint64_t counts[64], uint64_t word, uint64_t weight)
+{
+	for(int i = 0; i < 64; ++i)
+		counts[i] += ((word >> i) & 1) * weight;
+}
+
+/*
+	Positional popcount with the same CSA tree, but the adders work per bit position rather than
+	per word. Only 1 of 16 words is spread into the 64 counters, the others are folded into the
+	planes "ones" to "eights".
+*/
+void harley_seal_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	uint64_t ones = 0, twos = 0, fours = 0, eights = 0, sixteens = 0;
+	uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB;
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		const uint64_t* w = words + i;
+		CSA(twosA, ones, ones, w[ 0], w[ 1]);
+		CSA(twosB, ones, ones, w[ 2], w[ 3]);
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, w[ 4], w[ 5]);
+		CSA(twosB, ones, ones, w[ 6], w[ 7]);
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsA, fours, fours, foursA, foursB);
+		CSA(twosA, ones, ones, w[ 8], w[ 9]);
+		CSA(twosB, ones, ones, w[10], w[11]);
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, w[12], w[13]);
+		CSA(twosB, ones, ones, w[14], w[15]);
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsB, fours, fours, foursA, foursB);
+		CSA(sixteens, eights, eights, eightsA, eightsB);
+		add_positions(counts, sixteens, 16);
+	}
+
+	add_positions(counts, eights, 8);
+	add_positions(counts, fours, 4);
+	add_positions(counts, twos, 2);
+	add_positions(counts, ones, 1);
+	for(; i < count; ++i)
+		add_positions(counts, words[i], 1);
+}
+
+#if POPCOUNT_X86
+
+/*
+ * Popcount of each byte by looking up both nibbles in a 16-entry table with pshufb, then the bytes
+ * are summed into four 64-bit counts with psadbw.
+ */
+__attribute__((target("avx2")))
+static inline __m256i popcount256(__m256i v)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+	const __m256i lo = _mm256_and_si256(v, low);
+	const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+	const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+	return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t sum256(__m256i v)
+{
+	// stored rather than extracted, _mm256_extract_epi64 only exists on x86-64.
+	uint64_t lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+template <BitOperation OPERATION>
+__attribute__((target("avx2")))
+static inline __m256i combine256(__m256i a, __m256i b)
+{
+	switch(OPERATION)
+	{
+	case BIT_AND: return _mm256_and_si256(a, b);
+	case BIT_OR:  return _mm256_or_si256(a, b);
+	case BIT_XOR: return _mm256_xor_si256(a, b);
+	default:      return _mm256_andnot_si256(b, a);
+	}
+}
+
+struct BufferLoad256
+{
+	const __m256i* v;
+
+	__attribute__((target("avx2")))
+	__m256i operator()(size_t k) const
+	{
+		return _mm256_loadu_si256(v + k);
+	}
+};
+
+template <BitOperation OPERATION>
+struct PairLoad256
+{
+	const __m256i* a;
+	const __m256i* b;
+
+	__attribute__((target("avx2")))
+	__m256i operator()(size_t k) const
+	{
+		return combine256<OPERATION>(_mm256_loadu_si256(a + k), _mm256_loadu_si256(b + k));
+	}
+};
+
+/*
+ * Harley-Seal count of vectors [0, @p count).
+ */
+template <typename Load>
+__attribute__((target("avx2")))
+static uint64_t harley_seal_count256(const Load& load, size_t count)
+{
+	__m256i total = _mm256_setzero_si256();
+	__m256i ones = _mm256_setzero_si256(), twos = ones, fours = ones, eights = ones, sixteens;
+	__m256i twosA, twosB, foursA, foursB, eightsA, eightsB;
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		CSA(twosA, ones, ones, load(i +  0), load(i +  1));
+		CSA(twosB, ones, ones, load(i +  2), load(i +  3));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, load(i +  4), load(i +  5));
+		CSA(twosB, ones, ones, load(i +  6), load(i +  7));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsA, fours, fours, foursA, foursB);
+		CSA(twosA, ones, ones, load(i +  8), load(i +  9));
+		CSA(twosB, ones, ones, load(i + 10), load(i + 11));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, load(i + 12), load(i + 13));
+		CSA(twosB, ones, ones, load(i + 14), load(i + 15));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsB, fours, fours, foursA, foursB);
+		CSA(sixteens, eights, eights, eightsA, eightsB);
+		total = _mm256_add_epi64(total, popcount256(sixteens));
+	}
+
+	total = _mm256_slli_epi64(total, 4);
+	total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(eights), 3));
+	total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(fours), 2));
+	total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(twos), 1));
+	total = _mm256_add_epi64(total, popcount256(ones));
+	for(; i < count; ++i)
+		total = _mm256_add_epi64(total, popcount256(load(i)));
+	return sum256(total);
+}
+
+__attribute__((target("avx2")))
+uint64_t avx2_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	const size_t count = size / sizeof(__m256i);
+	const size_t offset = count * sizeof(__m256i);
+	return harley_seal_count256(BufferLoad256{reinterpret_cast<const __m256i*>(p)}, count)
+			+ hacker_popcnt_buffer(p + offset, size - offset);
+}
+
+/*
+ * The byte table widened to 32-bit entries, as a gather loads 32-bit lanes.
+ */
+struct GatherTable
+{
+	int count[256];
+};
+
+static constexpr GatherTable make_gather_table()
+{
+	GatherTable table = {{0}};
+	for(int i = 0; i < 256; ++i)
+		table.count[i] = popcount_byte(static_cast<uint8_t>(i));
+	return table;
+}
+
+static constexpr GatherTable GATHER_TABLE = make_gather_table();
+
+__attribute__((target("avx2")))
+uint64_t avx2_gather_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	const __m256i low = _mm256_set1_epi32(0xFF);
+	uint64_t total = 0;
+	size_t i = 0;
+	while(i + sizeof(__m256i) <= size)
+	{
+		// a 32-bit lane gains at most 32 per vector, it's widened before it overflows.
+		const size_t end = std::min(size, i + (size_t(1) << 20) * sizeof(__m256i));
+		__m256i counts = _mm256_setzero_si256();
+		for(; i + sizeof(__m256i) <= end; i += sizeof(__m256i))
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+			const __m256i byte0 = _mm256_and_si256(v, low);
+			const __m256i byte1 = _mm256_and_si256(_mm256_srli_epi32(v, 8), low);
+			const __m256i byte2 = _mm256_and_si256(_mm256_srli_epi32(v, 16), low);
+			const __m256i byte3 = _mm256_srli_epi32(v, 24);
+			counts = _mm256_add_epi32(counts, _mm256_add_epi32(
+					_mm256_add_epi32(_mm256_i32gather_epi32(GATHER_TABLE.count, byte0, 4),
+							_mm256_i32gather_epi32(GATHER_TABLE.count, byte1, 4)),
+					_mm256_add_epi32(_mm256_i32gather_epi32(GATHER_TABLE.count, byte2, 4),
+							_mm256_i32gather_epi32(GATHER_TABLE.count, byte3, 4))));
+		}
+		const __m256i zero = _mm256_setzero_si256();
+		total += sum256(_mm256_add_epi64(_mm256_unpacklo_epi32(counts, zero), _mm256_unpackhi_epi32(counts, zero)));
+	}
+	return total + lookup_popcnt_buffer(p + i, size - i);
+}
+
+/*
+ * Whole vectors go through @p load, the words after them through the scalar kernel.
+ */
+template <BitOperation OPERATION>
+__attribute__((target("avx2")))
+static uint64_t avx2_popcnt_pair(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	const size_t vectorCount = count / 4, done = vectorCount * 4;
+	const PairLoad256<OPERATION> load = {reinterpret_cast<const __m256i*>(a), reinterpret_cast<const __m256i*>(b)};
+	return harley_seal_count256(load, vectorCount)
+			+ harley_seal_count64(PairLoad64<OPERATION>{a + done, b + done}, count - done);
+}
+
+uint64_t avx2_popcnt_and(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx2_popcnt_pair<BIT_AND>(a, b, count);
+}
+
+uint64_t avx2_popcnt_or(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx2_popcnt_pair<BIT_OR>(a, b, count);
+}
+
+uint64_t avx2_popcnt_xor(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx2_popcnt_pair<BIT_XOR>(a, b, count);
+}
+
+uint64_t avx2_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx2_popcnt_pair<BIT_ANDNOT>(a, b, count);
+}
+
+template <BitOperation OPERATION>
+__attribute__((target("avx512f")))
+static inline __m512i combine512(__m512i a, __m512i b)
+{
+	switch(OPERATION)
+	{
+	case BIT_AND: return _mm512_and_si512(a, b);
+	case BIT_OR:  return _mm512_or_si512(a, b);
+	case BIT_XOR: return _mm512_xor_si512(a, b);
+	default:      return _mm512_ternarylogic_epi64(a, b, b, 0x30);  // 0x30 is the truth table of a & ~b.
+	}
+}
+
+struct BufferLoad512
+{
+	const __m512i* v;
+
+	__attribute__((target("avx512f")))
+	__m512i operator()(size_t k) const
+	{
+		return _mm512_loadu_si512(v + k);
+	}
+};
+
+template <BitOperation OPERATION>
+struct PairLoad512
+{
+	const __m512i* a;
+	const __m512i* b;
+
+	__attribute__((target("avx512f")))
+	__m512i operator()(size_t k) const
+	{
+		return combine512<OPERATION>(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k));
+	}
+};
+
+/*
+ * VPOPCNTDQ counts each 64-bit lane in one instruction, no CSA is needed. Four accumulators hide
+ * the latency of the instruction.
+ */
+template <typename Load>
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t vpopcnt_count512(const Load& load, size_t count)
+{
+	__m512i total0 = _mm512_setzero_si512(), total1 = total0, total2 = total0, total3 = total0;
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		total0 = _mm512_add_epi64(total0, _mm512_popcnt_epi64(load(i)));
+		total1 = _mm512_add_epi64(total1, _mm512_popcnt_epi64(load(i + 1)));
+		total2 = _mm512_add_epi64(total2, _mm512_popcnt_epi64(load(i + 2)));
+		total3 = _mm512_add_epi64(total3, _mm512_popcnt_epi64(load(i + 3)));
+	}
+	for(; i < count; ++i)
+		total0 = _mm512_add_epi64(total0, _mm512_popcnt_epi64(load(i)));
+
+	const __m512i total = _mm512_add_epi64(_mm512_add_epi64(total0, total1), _mm512_add_epi64(total2, total3));
+	uint64_t lanes[8];
+	_mm512_storeu_si512(lanes, total);
+	uint64_t sum = 0;
+	for(const uint64_t& lane: lanes)
+		sum += lane;
+	return sum;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+uint64_t avx512_popcnt_buffer(const void* buffer, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(buffer);
+	const size_t count = size / sizeof(__m512i);
+	const size_t offset = count * sizeof(__m512i);
+	return vpopcnt_count512(BufferLoad512{reinterpret_cast<const __m512i*>(p)}, count)
+			+ hacker_popcnt_buffer(p + offset, size - offset);
+}
+
+template <BitOperation OPERATION>
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t avx512_popcnt_pair(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	const size_t vectorCount = count / 8, done = vectorCount * 8;
+	const PairLoad512<OPERATION> load = {reinterpret_cast<const __m512i*>(a), reinterpret_cast<const __m512i*>(b)};
+	return vpopcnt_count512(load, vectorCount)
+			+ harley_seal_count64(PairLoad64<OPERATION>{a + done, b + done}, count - done);
+}
+
+uint64_t avx512_popcnt_and(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx512_popcnt_pair<BIT_AND>(a, b, count);
+}
+
+uint64_t avx512_popcnt_or(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx512_popcnt_pair<BIT_OR>(a, b, count);
+}
+
+uint64_t avx512_popcnt_xor(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx512_popcnt_pair<BIT_XOR>(a, b, count);
+}
+
+uint64_t avx512_popcnt_andnot(const uint64_t* a, const uint64_t* b, size_t count)
+{
+	return avx512_popcnt_pair<BIT_ANDNOT>(a, b, count);
+}
+
+/*
+	The AVX2 positional popcount runs the CSA tree over 16 vectors, namely 64 words. Bit b of each
+	16-bit lane of "sixteens" is added to the 16-bit counter acc[b], so lane j of acc[b] counts
+	bit 16 * (j % 4) + b of the words. The counters are spread into counts before they overflow.
+*/
+__attribute__((target("avx2")))
+static inline void add_lane_bits(__m256i acc[16], __m256i v)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+	for(int b = 0; b < 16; ++b)
+	{
+		acc[b] = _mm256_add_epi16(acc[b], _mm256_and_si256(v, one));
+		v = _mm256_srli_epi16(v, 1);
+	}
+}
+
+__attribute__((target("avx2")))
+static void flush_lane_bits(__m256i acc[16], uint64_t counts[64], uint64_t weight)
+{
+	uint16_t lanes[16];
+	for(int b = 0; b < 16; ++b)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc[b]);
+		for(int j = 0; j < 16; ++j)
+			counts[16 * (j % 4) + b] += lanes[j] * weight;
+		acc[b] = _mm256_setzero_si256();
+	}
+}
+
+__attribute__((target("avx2")))
+static void add_plane(uint64_t counts[64], __m256i plane, uint64_t weight)
+{
+	uint64_t w[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(w), plane);
+	for(const uint64_t& word: w)
+		add_positions(counts, word, weight);
+}
+
+__attribute__((target("avx2")))
+void avx2_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	const __m256i* v = reinterpret_cast<const __m256i*>(words);
+	const size_t vectorCount = count / 4;
+	__m256i acc[16];
+	for(__m256i& a: acc)
+		a = _mm256_setzero_si256();
+	__m256i ones = _mm256_setzero_si256(), twos = ones, fours = ones, eights = ones, sixteens;
+	__m256i twosA, twosB, foursA, foursB, eightsA, eightsB;
+	size_t i = 0, blocks = 0;
+	for(; i + 16 <= vectorCount; i += 16)
+	{
+#define LOAD(k) _mm256_loadu_si256(v + i + (k))
+		CSA(twosA, ones, ones, LOAD( 0), LOAD( 1));
+		CSA(twosB, ones, ones, LOAD( 2), LOAD( 3));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, LOAD( 4), LOAD( 5));
+		CSA(twosB, ones, ones, LOAD( 6), LOAD( 7));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsA, fours, fours, foursA, foursB);
+		CSA(twosA, ones, ones, LOAD( 8), LOAD( 9));
+		CSA(twosB, ones, ones, LOAD(10), LOAD(11));
+		CSA(foursA, twos, twos, twosA, twosB);
+		CSA(twosA, ones, ones, LOAD(12), LOAD(13));
+		CSA(twosB, ones, ones, LOAD(14), LOAD(15));
+		CSA(foursB, twos, twos, twosA, twosB);
+		CSA(eightsB, fours, fours, foursA, foursB);
+		CSA(sixteens, eights, eights, eightsA, eightsB);
+#undef LOAD
+		add_lane_bits(acc, sixteens);
+		if(++blocks == UINT16_MAX)  // a 16-bit counter is about to overflow.
+		{
+			flush_lane_bits(acc, counts, 16);
+			blocks = 0;
+		}
+	}
+
+	flush_lane_bits(acc, counts, 16);
+	add_plane(counts, eights, 8);
+	add_plane(counts, fours, 4);
+	add_plane(counts, twos, 2);
+	add_plane(counts, ones, 1);
+	for(size_t k = i * 4; k < count; ++k)
+		add_positions(counts, words[k], 1);
+}
+
+#else  // the instructions are missing, fall back to the portable CSA.
+
+uint64_t avx2_popcnt_buffer(const void* buffer, size_t size)
+{
+	return harley_seal_popcnt_buffer(buffer, size);
+}
+
+uint64_t avx512_popcnt_buffer(const void* buffer, size_t size)
+{
+	return harley_seal_popcnt_buffer(buffer, size);
+}
+
+uint64_t avx2_gather_popcnt_buffer(const void* buffer, size_t size)
+{
+	return lookup_popcnt_buffer(buffer, size);
+}
+
+void avx2_positional_popcnt(const uint64_t* words, size_t count, uint64_t counts[64])
+{
+	harley_seal_positional_popcnt(words, count, counts);
+}
+
+#define FALLBACK_POPCNT_PAIR(name, fallback) \
+	uint64_t name(const uint64_t* a, const uint64_t* b, size_t count) { return fallback(a, b, count); }
+
+FALLBACK_POPCNT_PAIR(avx2_popcnt_and, harley_seal_popcnt_and)
+FALLBACK_POPCNT_PAIR(avx2_popcnt_or, harley_seal_popcnt_or)
+FALLBACK_POPCNT_PAIR(avx2_popcnt_xor, harley_seal_popcnt_xor)
+FALLBACK_POPCNT_PAIR(avx2_popcnt_andnot, harley_seal_popcnt_andnot)
+FALLBACK_POPCNT_PAIR(avx512_popcnt_and, harley_seal_popcnt_and)
+FALLBACK_POPCNT_PAIR(avx512_popcnt_or, harley_seal_popcnt_or)
+FALLBACK_POPCNT_PAIR(avx512_popcnt_xor, harley_seal_popcnt_xor)
+FALLBACK_POPCNT_PAIR(avx512_popcnt_andnot, harley_seal_popcnt_andnot)
+
+#undef FALLBACK_POPCNT_PAIR
+
+#endif  // POPCOUNT_X86
@@ -0,0 +1,273 @@
+#include <cassert>
+
+#include "popcount.h"
+#include "popcount_constexpr.h"
+#include "rank_select.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RANK_SELECT_X86 1
+#else
+#define RANK_SELECT_X86 0
+#endif
+
+#if defined(__GNUC__)
+#define RANK_SELECT_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define RANK_SELECT_INLINE __forceinline
+#else
+#define RANK_SELECT_INLINE inline
+#endif
+
+static constexpr uint64_t UPPER_BITS = uint64_t(1) << 32;
+static constexpr size_t LOWER_BITS = 2048;
+static constexpr size_t BLOCK_BITS = 512;
+static constexpr uint64_t SAMPLE_ONES = 8192;
+
+/*
+	The in-word operations of each tier. They are always inlined, so __builtin_popcountll becomes
+	POPCNT only inside the kernels compiled for it. Off x86 only the portable tier exists.
+*/
+struct PortableOps
+{
+	static RANK_SELECT_INLINE int popcount(uint64_t word)
+	{
+		return ::popcount<uint64_t>(word);
+	}
+
+	/*
+	 * Position of the one of @p word with @p r ones before it, find its byte then clear lower ones.
+	 */
+	static RANK_SELECT_INLINE int select(uint64_t word, int r)
+	{
+		int shift = 0;
+		for(int c; r >= (c = popcount_byte(static_cast<uint8_t>(word >> shift))); shift += 8)
+			r -= c;
+		uint64_t byte = (word >> shift) & 0xFF;
+		for(; r > 0; --r)
+			byte &= byte - 1;
+		return shift + popcount_byte(static_cast<uint8_t>((byte & (0 - byte)) - 1));  // trailing zeros.
+	}
+};
+
+#if RANK_SELECT_X86
+struct HardwareOps
+{
+	static RANK_SELECT_INLINE int popcount(uint64_t word)
+	{
+		return __builtin_popcountll(word);
+	}
+
+	static RANK_SELECT_INLINE int select(uint64_t word, int r)
+	{
+		return PortableOps::select(word, r);
+	}
+};
+
+// _pdep_u64 and _tzcnt_u64 only exist on x86-64, 32-bit x86 selects with POPCNT.
+#if defined(__x86_64__)
+struct Bmi2Ops
+{
+	static RANK_SELECT_INLINE int popcount(uint64_t word)
+	{
+		return __builtin_popcountll(word);
+	}
+
+	/*
+	 * PDEP deposits a single bit at the position of the wanted one.
+	 */
+	__attribute__((target("bmi,bmi2")))
+	static inline int select(uint64_t word, int r)
+	{
+		return static_cast<int>(_tzcnt_u64(_pdep_u64(uint64_t(1) << r, word)));
+	}
+};
+#endif
+#endif
+
+struct RankSelectKernel
+{
+	static uint64_t cumulative(const RankSelect& self, size_t entry)
+	{
+		return self.upper[entry * LOWER_BITS / UPPER_BITS] + (self.lower[entry] & 0xFFFFFFFF);
+	}
+
+	template <typename Ops>
+	static RANK_SELECT_INLINE uint64_t rank(const RankSelect& self, size_t i)
+	{
+		assert(i <= self.length);
+		const uint64_t entry = self.lower[i / LOWER_BITS];
+		uint64_t count = self.upper[i / UPPER_BITS] + (entry & 0xFFFFFFFF);
+		const int block = static_cast<int>(i / BLOCK_BITS % 4);
+		for(int b = 0; b < block; ++b)
+			count += (entry >> (32 + 10 * b)) & 0x3FF;
+
+		const size_t last = i / 64;
+		for(size_t w = i / BLOCK_BITS * (BLOCK_BITS / 64); w < last; ++w)
+			count += Ops::popcount(self.words[w]);
+		if(i % 64 != 0)
+			count += Ops::popcount(self.words[last] & ((uint64_t(1) << (i % 64)) - 1));
+		return count;
+	}
+
+	template <typename Ops>
+	static RANK_SELECT_INLINE size_t select(const RankSelect& self, uint64_t k)
+	{
+		assert(k < self.ones);
+		// the last lower entry with no more than k ones before it, it lies between two samples.
+		const size_t sample = static_cast<size_t>(k / SAMPLE_ONES);
+		size_t low = self.samples[sample];
+		size_t high = sample + 1 < self.samples.size()? self.samples[sample + 1]: self.lower.size() - 1;
+		while(low < high)
+		{
+			const size_t middle = (low + high + 1) / 2;
+			if(cumulative(self, middle) <= k)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+
+		uint64_t r = k - cumulative(self, low);
+		const uint64_t entry = self.lower[low];
+		size_t block = low * (LOWER_BITS / BLOCK_BITS);
+		for(int b = 0; b < 3; ++b, ++block)
+		{
+			const uint64_t c = (entry >> (32 + 10 * b)) & 0x3FF;
+			if(r < c)
+				break;
+			r -= c;
+		}
+
+		size_t w = block * (BLOCK_BITS / 64);
+		for(uint64_t c; r >= (c = Ops::popcount(self.words[w])); ++w)
+			r -= c;
+		return w * 64 + Ops::select(self.words[w], static_cast<int>(r));
+	}
+};
+
+static uint64_t rank_portable(const RankSelect& self, size_t i)
+{
+	return RankSelectKernel::rank<PortableOps>(self, i);
+}
+
+static size_t select_portable(const RankSelect& self, uint64_t k)
+{
+	return RankSelectKernel::select<PortableOps>(self, k);
+}
+
+#if RANK_SELECT_X86
+__attribute__((target("popcnt")))
+static uint64_t rank_popcnt(const RankSelect& self, size_t i)
+{
+	return RankSelectKernel::rank<HardwareOps>(self, i);
+}
+
+__attribute__((target("popcnt")))
+static size_t select_popcnt(const RankSelect& self, uint64_t k)
+{
+	return RankSelectKernel::select<HardwareOps>(self, k);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt,bmi,bmi2")))
+static size_t select_bmi2(const RankSelect& self, uint64_t k)
+{
+	return RankSelectKernel::select<Bmi2Ops>(self, k);
+}
+#endif
+#endif
+
+RankSelect::RankSelect(const uint64_t* words, size_t size, const CpuFeatures& features):
+		words(words),
+		length(size),
+		ones(0),
+		rankFunc(rank_portable),
+		selectFunc(select_portable),
+		tierName("portable")
+{
+#if RANK_SELECT_X86
+	if(features.popcnt)
+	{
+		rankFunc = rank_popcnt;
+		selectFunc = select_popcnt;
+		tierName = "popcnt";
+	}
+#if defined(__x86_64__)
+	if(features.popcnt && features.bmi1 && features.bmi2)
+	{
+		selectFunc = select_bmi2;
+		tierName = "popcnt+bmi2";
+	}
+#endif
+#else
+	(void)features;
+#endif
+
+	// one more lower entry than whole ones, so rank1(size()) has an entry to read.
+	const size_t wordCount = (size + 63) / 64;
+	const size_t lowerCount = size / LOWER_BITS + 1;
+	upper.reserve(size / UPPER_BITS + 1);
+	lower.reserve(lowerCount);
+	samples.reserve(static_cast<size_t>(size / SAMPLE_ONES / 2 + 1));
+
+	uint64_t base = 0;
+	for(size_t e = 0; e < lowerCount; ++e)
+	{
+		if(e * LOWER_BITS % UPPER_BITS == 0)
+		{
+			upper.push_back(ones);
+			base = ones;
+		}
+
+		uint64_t entry = ones - base;
+		for(size_t b = 0; b < LOWER_BITS / BLOCK_BITS; ++b)
+		{
+			uint64_t count = 0;
+			const size_t first = (e * (LOWER_BITS / BLOCK_BITS) + b) * (BLOCK_BITS / 64);
+			for(size_t w = first; w < first + BLOCK_BITS / 64 && w < wordCount; ++w)
+			{
+				uint64_t word = words[w];
+				if((w + 1) * 64 > size)  // clear the bits after size.
+					word &= (uint64_t(1) << (size % 64)) - 1;
+				count += hacker_popcnt64(word);
+			}
+			if(b < 3)
+				entry |= count << (32 + 10 * b);
+			ones += count;
+		}
+		lower.push_back(entry);
+
+		while(samples.size() * SAMPLE_ONES < ones)  // the next sampled one lies in this entry.
+			samples.push_back(static_cast<uint32_t>(e));
+	}
+}
+
+size_t RankSelect::size() const
+{
+	return length;
+}
+
+uint64_t RankSelect::count() const
+{
+	return ones;
+}
+
+uint64_t RankSelect::rank1(size_t i) const
+{
+	return rankFunc(*this, i);
+}
+
+size_t RankSelect::select1(uint64_t k) const
+{
+	return selectFunc(*this, k);
+}
+
+size_t RankSelect::space() const
+{
+	return upper.size() * sizeof(uint64_t) + lower.size() * sizeof(uint64_t) + samples.size() * sizeof(uint32_t);
+}
+
+const char* RankSelect::tier() const
+{
+	return tierName;
+}
@@ -0,0 +1,77 @@
+#ifndef GITHUB_KALO2_POPCOUNT_RANK_SELECT_
+#define GITHUB_KALO2_POPCOUNT_RANK_SELECT_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+
+/**
+ * Rank and select over a bit vector with the poppy layout, the index takes 3.125% of the vector
+ * for counts plus at most 0.4% for select samples.
+ *
+ * - An upper entry holds the number of ones before each 2^32 bits, in 64 bits.
+ * - A lower entry covers 2048 bits in 64 bits, the ones before it since its upper entry in 32
+ *   bits, then the counts of its first three 512-bit blocks in 10 bits each. The counts sit
+ *   together, so a rank reads one lower entry and at most 8 words of one block.
+ * - Select samples the lower entry of every 8192nd one, then searches the lower entries between
+ *   two samples, the blocks of the entry and the words of the block.
+ *
+ * @see Dong Zhou, David G. Andersen, Michael Kaminsky, Space-Efficient, High-Performance Rank &
+ *      Select Structures on Uncompressed Bit Sequences. SEA 2013.
+ */
+class RankSelect
+{
+private:
+	const uint64_t* words;
+	size_t length;  // in bits.
+	uint64_t ones;
+	std::vector<uint64_t> upper;
+	std::vector<uint64_t> lower;
+	std::vector<uint32_t> samples;
+
+	// bound to the fastest in-word popcount and select of the CPU.
+	uint64_t (*rankFunc)(const RankSelect& self, size_t i);
+	size_t (*selectFunc)(const RankSelect& self, uint64_t k);
+	const char* tierName;
+
+	friend struct RankSelectKernel;
+
+public:
+	/**
+	 * Index the first @p size bits of @p words, they must outlive the index. Bits after @p size in
+	 * the last word are ignored.
+	 * @param features the CPU features to use, those of the running CPU by default.
+	 */
+	RankSelect(const uint64_t* words, size_t size, const CpuFeatures& features = cpu_features());
+
+	size_t size() const;
+
+	/**
+	 * @return the number of ones.
+	 */
+	uint64_t count() const;
+
+	/**
+	 * @return the number of ones in [0, @p i), @p i <= size().
+	 */
+	uint64_t rank1(size_t i) const;
+
+	/**
+	 * @return the position of the one that has @p k ones before it, @p k < count().
+	 */
+	size_t select1(uint64_t k) const;
+
+	/**
+	 * @return bytes of the index, excluding the bit vector.
+	 */
+	size_t space() const;
+
+	/**
+	 * @return "portable", "popcnt" or "popcnt+bmi2", the instructions of in-word work.
+	 */
+	const char* tier() const;
+};
+
+#endif  // GITHUB_KALO2_POPCOUNT_RANK_SELECT_
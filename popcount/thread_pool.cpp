@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threads):
+		task(nullptr),
+		taskCount(0),
+		nextTask(0),
+		finished(0),
+		generation(0),
+		stopping(false)
+{
+	if(threads == 0)
+		threads = std::max(1U, std::thread::hardware_concurrency());
+	for(unsigned t = 1; t < threads; ++t)
+		workers.emplace_back(&ThreadPool::work, this, t);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+	for(std::thread& worker: workers)
+		worker.join();
+}
+
+unsigned ThreadPool::size() const
+{
+	return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void ThreadPool::take(const Task& job, size_t count, unsigned thread)
+{
+	for(size_t i; (i = nextTask.fetch_add(1, std::memory_order_relaxed)) < count;)
+		job(i, thread);
+}
+
+void ThreadPool::work(unsigned thread)
+{
+	uint64_t seen = 0;
+	for(;;)
+	{
+		const Task* job;
+		size_t count;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&]() { return stopping || generation != seen; });
+			if(stopping)
+				return;
+			seen = generation;
+			job = task;
+			count = taskCount;
+		}
+
+		take(*job, count, thread);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(++finished == workers.size())
+			doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::run(size_t count, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		taskCount = count;
+		nextTask.store(0, std::memory_order_relaxed);
+		finished = 0;
+		++generation;
+	}
+	wakeCondition.notify_all();
+
+	take(task, count, 0);
+
+	// every worker must check in, even one that wakes after the tasks are gone, so none of them
+	// sees the next job's state half written.
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [&]() { return finished == workers.size(); });
+	this->task = nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef GITHUB_KALO2_POPCOUNT_THREAD_POOL_
+#define GITHUB_KALO2_POPCOUNT_THREAD_POOL_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads that run the tasks of one job at a time. The tasks are taken in order from a shared
+ * counter, so a thread that finishes early takes more, and the calling thread takes its share
+ * too.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void(size_t task, unsigned thread)> Task;
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;  // a job is posted, or the pool is stopping.
+	std::condition_variable doneCondition;  // every worker finished the job.
+	const Task* task;
+	size_t taskCount;
+	std::atomic<size_t> nextTask;
+	unsigned finished;    // workers done with the current job.
+	uint64_t generation;  // counts jobs, so a worker runs each job once.
+	bool stopping;
+
+	void work(unsigned thread);
+	void take(const Task& job, size_t count, unsigned thread);
+
+public:
+	/**
+	 * @param threads including the calling thread, 0 for the number of hardware threads.
+	 */
+	explicit ThreadPool(unsigned threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @return the number of threads, including the calling thread.
+	 */
+	unsigned size() const;
+
+	/**
+	 * Run @p task for tasks 0 to @p count - 1, it returns when all of them have finished.
+	 * @p task gets the task index and the index of the running thread, the caller is thread 0.
+	 */
+	void run(size_t count, const Task& task);
+};
+
+#endif  // GITHUB_KALO2_POPCOUNT_THREAD_POOL_
@@ -16,19 +16,76 @@ constexpr int32_t Sudoku::INVALID_POSTION;
 constexpr uint8_t Sudoku::INVALID_NUMBER;
 #endif
 
-const char* Sudoku::GROUP_TEXT[4] = {"none", "row", "column", "block"};
+const char* Sudoku::GROUP_TEXT[5] = {"none", "row", "column", "block", "extra"};
 
-template <typename T>
-static inline bool removeElement(std::vector<T>& array, const T& element)
+const char* Sudoku::TECHNIQUE_TEXT[TECHNIQUE_COUNT] =
 {
-	auto it = std::find(array.begin(), array.end(), element);
-	if(it != array.end())
-	{
-		array.erase(it);
-		return true;
-	}
+	"none", "hidden single", "naked single", "locked candidate", "naked pair", "X-Wing", "multiple lines",
+	"naked triple", "swordfish", "finned fish", "simple coloring", "XY-chain", "jellyfish",
+	"alternating inference chain", "backtrack",
+};
+
+const char* Sudoku::STATUS_TEXT[6] = {"solved", "unsolved", "no solution", "node limit", "deadline", "cancelled"};
+
+// Scores follow Sudoku Explainer's scale roughly.
+const float Sudoku::TECHNIQUE_SCORE[TECHNIQUE_COUNT] =
+{
+	1.0F, 1.5F, 2.3F, 2.6F, 3.0F, 3.2F, 3.4F,
+	3.6F, 3.8F, 4.0F, 4.2F, 4.6F, 5.2F,
+	6.0F, 10.0F,
+};
+
+static constexpr uint8_t FISH_SIZE_MAX = 4;  // jellyfish, larger fish always has a smaller complement.
+static constexpr uint8_t FIN_COUNT_MAX = 2;
+static constexpr uint32_t CHAIN_BUDGET = 1 << 16;  // chain nodes or color checks per strategy call
+static constexpr uint64_t CLOCK_INTERVAL_MASK = 0xFF;  // read the clock once every 256 guesses
+
+static inline uint8_t bitCount(uint64_t mask)
+{
+#if defined(__GNUC__)
+	return static_cast<uint8_t>(__builtin_popcountll(mask));
+#else
+	uint8_t count = 0;
+	for(; mask != 0; mask &= mask - 1)
+		++count;
+	return count;
+#endif
+}
+
+/**
+ * @param mask must not be zero.
+ * @return index of the lowest set bit.
+ */
+static inline uint8_t lowestBit(uint64_t mask)
+{
+	assert(mask != 0);
+#if defined(__GNUC__)
+	return static_cast<uint8_t>(__builtin_ctzll(mask));
+#else
+	uint8_t index = 0;
+	for(; (mask & 1) == 0; mask >>= 1)
+		++index;
+	return index;
+#endif
+}
+
+/**
+ * Step @p indices to the next combination of @p size elements out of @p count, in lexicographical
+ * order.
+ * @return false if @p indices is already the last combination.
+ */
+static inline bool nextCombination(uint8_t* indices, uint8_t size, uint8_t count)
+{
+	int8_t i = size - 1;
+	while(i >= 0 && indices[i] == count - size + i)
+		--i;
+	if(i < 0)
+		return false;
 	
-	return false;
+	++indices[i];
+	for(uint8_t j = i + 1; j < size; ++j)
+		indices[j] = indices[j - 1] + 1;
+	return true;
 }
 
 uint8_t Sudoku::toNumber(char letter)
@@ -91,131 +148,402 @@ std::vector<uint8_t> Sudoku::parse(const char* letters, int32_t length, char pla
 	return array;
 }
 
-Sudoku::Sudoku(uint8_t rank, const char* states, const char* blocks, char placeholder/* = '0'*/) noexcept(false):
+Sudoku::Sudoku(uint8_t rank, const char* states, const char* blocks, char placeholder/* = '0'*/,
+		const std::vector<std::vector<int32_t>>& extraUnits/* = {} */) noexcept(false):
+		Sudoku(rank, states, blocks, placeholder, extraUnits, throwIfInvalid(check(rank, states, blocks, placeholder, extraUnits)))
+{
+}
+
+Sudoku::Sudoku(uint8_t rank, const char* states, const char* blocks, char placeholder,
+		const std::vector<std::vector<int32_t>>& extraUnits, const Diagnostic& diagnostic):
 		rank(rank),
 		initialState(placeholder == '0'? parse(states, rank * rank) : parse(states, rank * rank, placeholder)),
 		blockIndices(placeholder == '0'? parse(blocks, rank * rank) : parse(blocks, rank * rank, placeholder)),
-		field(rank * rank, INVALID_NUMBER),
-		map(rank * rank, INVALID_POSTION)
+		verbose(true),
+		nodeCount(0)
 {
-	assert(0 < rank && rank <= RANK_MAX);
-	if(rank <= 0 || rank > RANK_MAX)
-		throw std::invalid_argument("invalid rank");
+	assert(diagnostic.error == ERROR_NONE);
+	(void)diagnostic;
+	
+	// rows, columns, blocks, then extra units.
+	const int32_t positionCount = rank * rank;
+	unitCount = 3 * rank + static_cast<int32_t>(extraUnits.size());
+	units.resize(unitCount * rank);
+	cellUnits.assign(positionCount, std::vector<int32_t>());
+	cellSeats.assign(positionCount, std::vector<uint8_t>());
+	std::vector<uint8_t> blockSizes(1 + rank, 0);
+	for(int32_t position = 0; position < positionCount; ++position)
+	{
+		const uint8_t row = position / rank, column = position % rank;
+		const uint8_t& blockIndex = blockIndices[position];
+		const int32_t rowUnit = row, columnUnit = rank + column, blockUnit = 2 * rank + blockIndex - 1;
+		const uint8_t blockSeat = blockSizes[blockIndex]++;
+		units[rowUnit * rank + column] = position;
+		units[columnUnit * rank + row] = position;
+		units[blockUnit * rank + blockSeat] = position;
+		
+		cellUnits[position].reserve(3);
+		cellUnits[position].emplace_back(rowUnit);
+		cellUnits[position].emplace_back(columnUnit);
+		cellUnits[position].emplace_back(blockUnit);
+		cellSeats[position].reserve(3);
+		cellSeats[position].emplace_back(column);
+		cellSeats[position].emplace_back(row);
+		cellSeats[position].emplace_back(blockSeat);
+	}
+	
+	for(size_t u = 0; u < extraUnits.size(); ++u)
+	{
+		const int32_t unit = 3 * rank + static_cast<int32_t>(u);
+		std::copy(extraUnits[u].begin(), extraUnits[u].end(), units.begin() + unit * rank);
+		for(uint8_t i = 0; i < rank; ++i)
+		{
+			const int32_t& position = extraUnits[u][i];
+			cellUnits[position].emplace_back(unit);
+			cellSeats[position].emplace_back(i);
+		}
+	}
 	
-	if(!isBlockPartitionValid())
-		throw std::invalid_argument("invalid block partition");
+	allocate();
 	
 	// initialState and blockIndices data are initialized, go to field.
-	std::copy(initialState.begin(), initialState.end(), field.begin());
-	validate(field);
-
-//	blankCandidates.reserve(blankCount);  // changed from std::unordered_map to std::map, useless.
-	blankBlocks.resize(1 + rank);  // [0] is unused here.
-	const uint32_t positionCount = rank * rank;
-	for(uint32_t position = 0; position < positionCount; ++position)
+	std::copy(initialState.begin(), initialState.end(), field);
+	blankCount = 0;
+	for(int32_t position = 0; position < positionCount; ++position)
 	{
 		const uint8_t& number = field[position];
-		const uint8_t& blockIndex = blockIndices[position];
-		if(number != INVALID_NUMBER)
-			setMapPosition(blockIndex, number, position);
-		else
-			blankBlocks[blockIndex].emplace_back(position);
+		for(const int32_t& unit: cellUnits[position])
+		{
+			if(number != INVALID_NUMBER)
+				placedMasks.add(unit, uint64_t(1) << (number - 1));
+			else
+				++remaining[unit];
+		}
+		
+		if(number == INVALID_NUMBER)
+			++blankCount;
 	}
 	
-	for(uint32_t position = 0; position < positionCount; ++position)
+	const uint64_t all = (uint64_t(1) << rank) - 1;  // rank < 64
+	candidateCount = 0;
+	for(int32_t position = 0; position < positionCount; ++position)
 	{
 		if(field[position] != INVALID_NUMBER)
 			continue;
 		
-		std::vector<uint8_t> candidates;
-		candidates.reserve(rank);  // at most rank
-		for(uint8_t n = 1; n <= rank; ++n)
-			if(isSafe(position, n))
-				candidates.emplace_back(n);
+		uint64_t mask = all;
+		for(const int32_t& unit: cellUnits[position])
+			mask &= ~placedMasks[unit];
 		
-		blankCandidates.emplace(position, candidates);
+		candidates.set(position, mask);
+		candidateCount += bitCount(mask);
+		const std::vector<int32_t>& unitsOfCell = cellUnits[position];
+		for(size_t i = 0; i < unitsOfCell.size(); ++i)
+		for(uint64_t m = mask; m != 0; m &= m - 1)
+			locations.add(unitsOfCell[i] * rank + lowestBit(m), uint64_t(1) << cellSeats[position][i]);
 	}
 }
 
-void Sudoku::validate(const std::vector<uint8_t>& state) const noexcept(false)
+void Sudoku::allocate()
 {
-	bool flags[RANK_MAX];
+	// round each array up to whole cache lines.
+	constexpr size_t LINE_SIZE = 64;
+	auto lines = [](size_t bytes) -> size_t { return (bytes + LINE_SIZE - 1) / LINE_SIZE; };
+	
+	const size_t positionCount = rank * rank;
+	const uint8_t maskWidth = MaskArray::widthOf(rank);
+	const size_t candidateLines = lines(positionCount * maskWidth);
+	const size_t locationLines = lines(unitCount * rank * maskWidth);
+	const size_t placedLines = lines(unitCount * maskWidth);
+	const size_t fieldLines = lines(positionCount * sizeof(uint8_t));
+	const size_t remainingLines = lines(unitCount * sizeof(uint8_t));
+	const size_t lineCount = candidateLines + locationLines + placedLines + fieldLines + remainingLines;
+	
+	// std::vector doesn't align to cache line before C++17, one more line leaves room to align.
+	constexpr size_t WORDS_PER_LINE = LINE_SIZE / sizeof(uint64_t);
+	storage.assign((lineCount + 1) * WORDS_PER_LINE, 0);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+	uint8_t* line = reinterpret_cast<uint8_t*>((address + LINE_SIZE - 1) & ~uintptr_t(LINE_SIZE - 1));
+	
+	candidates.assign(line, maskWidth);
+	line += candidateLines * LINE_SIZE;
+	locations.assign(line, maskWidth);
+	line += locationLines * LINE_SIZE;
+	placedMasks.assign(line, maskWidth);
+	line += placedLines * LINE_SIZE;
+	field = line;
+	line += fieldLines * LINE_SIZE;
+	remaining = line;
+}
+
+Sudoku::Error Sudoku::tryCreate(std::unique_ptr<Sudoku>& sudoku, uint8_t rank, const char* state, const char* block,
+		char placeholder/* = '0' */, const std::vector<std::vector<int32_t>>& extraUnits/* = {} */,
+		Diagnostic* diagnostic/* = nullptr */)
+{
+	const Diagnostic result = check(rank, state, block, placeholder, extraUnits);
+	if(diagnostic)
+		*diagnostic = result;
 	
-#define FAST_FAIL(index, groupText, groupId)               \
-	const uint8_t& number = state[position];               \
-	if(number == INVALID_NUMBER)                           \
-		continue;                                          \
-	                                                       \
-	if(!flags[index])                                      \
-		flags[index] = true;                               \
-	else                                                   \
-	{                                                      \
-		std::ostringstream os;                             \
-		os << "found duplicate value "                     \
-				<< '\'' << toLetter(number) << '\''        \
-				<< " on " << groupText << ' ' << groupId;  \
-		throw std::invalid_argument(os.str());             \
-	}                                                      \
+	if(result.error != ERROR_NONE)
+		sudoku.reset();
+	else
+		sudoku.reset(new Sudoku(rank, state, block, placeholder, extraUnits, result));
 	
-	// check whether ROW group conflicts
-	for(uint8_t r = 0; r < rank; ++r)
+	return result.error;
+}
+
+std::vector<std::vector<int32_t>> Sudoku::getDiagonalUnits(uint8_t rank)
+{
+	std::vector<std::vector<int32_t>> units(2, std::vector<int32_t>(rank));
+	for(uint8_t i = 0; i < rank; ++i)
 	{
-		int32_t base = r * rank;
-		std::fill(flags, flags + RANK_MAX, false);
-		for(uint8_t c = 0; c < rank; ++c)
-		{
-			int32_t position = base + c;
-			FAST_FAIL(c, GROUP_TEXT[ROW], int16_t(r));
-		}
+		units[0][i] = i * rank + i;
+		units[1][i] = i * rank + (rank - 1 - i);
 	}
 	
-	// check whether COLUMN group conflicts
+	return units;
+}
+
+/*
+ * Windows are the gray blocks between regular blocks, take 9x9 for example, they are the 3x3 squares
+ * starting at (1, 1), (1, 5), (5, 1) and (5, 5).
+ */
+std::vector<std::vector<int32_t>> Sudoku::getWindowUnits(uint8_t rank)
+{
+	uint8_t size = 1;
+	while(size * size < rank)
+		++size;
+	
+	std::vector<std::vector<int32_t>> units;
+	if(size * size != rank)  // not a regular sudoku.
+		return units;
+	
+	for(uint8_t i = 0; i + 1 < size; ++i)
+	for(uint8_t j = 0; j + 1 < size; ++j)
+	{
+		const int32_t row = 1 + i * (size + 1), column = 1 + j * (size + 1);
+		std::vector<int32_t> unit;
+		unit.reserve(rank);
+		for(uint8_t r = 0; r < size; ++r)
+		for(uint8_t c = 0; c < size; ++c)
+			unit.emplace_back((row + r) * rank + column + c);
+		units.emplace_back(std::move(unit));
+	}
+	
+	return units;
+}
+
+std::vector<std::vector<int32_t>> Sudoku::getDisjointUnits(uint8_t rank, const char* block)
+{
+	assert(block);
+	std::vector<std::vector<int32_t>> units(rank);
+	std::vector<uint8_t> blockSizes(1 + rank, 0);
+	for(int32_t position = 0; position < rank * rank; ++position)
+	{
+		// toNumber() asserts on a malformed letter, skip those too, check() will report them.
+		const char letter = block[position];
+		if(letter == '\0')
+			break;  // the partition is short.
+		if(!(('0' <= letter && letter <= '9') || ('a' <= letter && letter <= 'z') || ('A' <= letter && letter <= 'Z')))
+			continue;
+		
+		const uint8_t blockIndex = toNumber(letter);
+		if(blockIndex == INVALID_NUMBER || blockIndex > rank || blockSizes[blockIndex] >= rank)
+			continue;  // invalid partition, check() will report it.
+		
+		const uint8_t index = blockSizes[blockIndex]++;  // the order of this cell in its block
+		units[index].emplace_back(position);
+	}
+	
+	return units;
+}
+
+/*
+ * Each row, column and block keeps a bit set of numbers that have shown, so a duplicate is found 
+ * with one test, the grid is walked only once.
+ */
+Sudoku::Diagnostic Sudoku::check(uint8_t rank, const char* states, const char* blocks, char placeholder,
+		const std::vector<std::vector<int32_t>>& extraUnits) noexcept
+{
+	Diagnostic diagnostic = {ERROR_NONE, NONE, 0, 0, 0, 0};
+	if(rank <= 0 || rank > RANK_MAX)
+	{
+		diagnostic.error = ERROR_RANK;
+		return diagnostic;
+	}
+	
+	if(!states || !blocks)
+	{
+		diagnostic.error = ERROR_LETTER;
+		return diagnostic;
+	}
+	
+	// map letter to number like parse() does, return INVALID_LETTER for malformed letters.
+	constexpr uint8_t INVALID_LETTER = 0xFF;
+	auto parseLetter = [placeholder](char letter) -> uint8_t
+	{
+		if(placeholder != '0' && (letter == ' ' || letter == '*' || letter == '.'))
+			return INVALID_NUMBER;
+		
+		if('0' <= letter && letter <= '9')
+			return letter - '0';
+		else if('a' <= letter && letter <= 'z')
+			return letter - 'a' + 10;
+		else if('A' <= letter && letter <= 'Z')
+			return letter - 'A' + 10;
+		else
+			return INVALID_LETTER;
+	};
+	
+	uint64_t rowMasks[RANK_MAX] = {0}, columnMasks[RANK_MAX] = {0}, blockMasks[1 + RANK_MAX] = {0};
+	uint8_t blockSizes[1 + RANK_MAX] = {0};
+	
+	for(uint8_t r = 0; r < rank; ++r)
 	for(uint8_t c = 0; c < rank; ++c)
 	{
-		std::fill(flags, flags + RANK_MAX, false);
-		for(uint8_t r = 0; r < rank; ++r)
+		const int32_t position = r * rank + c;
+		diagnostic.row = r;
+		diagnostic.column = c;
+		
+		const uint8_t blockIndex = parseLetter(blocks[position]);
+		if(blockIndex == INVALID_NUMBER || blockIndex > rank)
 		{
-			int32_t position = r * rank + c;
-			FAST_FAIL(r, GROUP_TEXT[COLUMN], int16_t(c));
+			diagnostic.error = blockIndex == INVALID_LETTER? ERROR_LETTER: ERROR_BLOCK_PARTITION;
+			diagnostic.group = BLOCK;
+			return diagnostic;
+		}
+		++blockSizes[blockIndex];
+		
+		const uint8_t number = parseLetter(states[position]);
+		if(number == INVALID_NUMBER)
+			continue;
+		
+		if(number > rank)
+		{
+			diagnostic.error = ERROR_LETTER;
+			return diagnostic;
+		}
+		
+		const uint64_t bit = uint64_t(1) << (number - 1);
+		Group group = NONE;
+		uint8_t index = 0;
+		if(rowMasks[r] & bit)
+			group = ROW, index = r;
+		else if(columnMasks[c] & bit)
+			group = COLUMN, index = c;
+		else if(blockMasks[blockIndex] & bit)
+			group = BLOCK, index = blockIndex;
+		
+		if(group != NONE)
+		{
+			diagnostic.error = ERROR_DUPLICATE;
+			diagnostic.group = group;
+			diagnostic.index = index;
+			diagnostic.number = number;
+			return diagnostic;
 		}
+		
+		rowMasks[r] |= bit;
+		columnMasks[c] |= bit;
+		blockMasks[blockIndex] |= bit;
 	}
-
-	// check whether BLOCK group conflicts
+	
+	diagnostic.row = diagnostic.column = 0;
 	for(uint8_t b = 1; b <= rank; ++b)
+		if(blockSizes[b] != rank)
+		{
+			diagnostic.error = ERROR_BLOCK_PARTITION;
+			diagnostic.group = BLOCK;
+			diagnostic.index = b;
+			return diagnostic;
+		}
+	
+	// extra units are walked after the grid, they are few.
+	const int32_t positionCount = rank * rank;
+	for(size_t u = 0; u < extraUnits.size(); ++u)
 	{
-		std::fill(flags, flags + RANK_MAX, false);
-		for(int32_t position = 0; position < rank * rank; ++position)
+		const std::vector<int32_t>& unit = extraUnits[u];
+		diagnostic.group = EXTRA;
+		diagnostic.index = static_cast<uint8_t>(u);
+		if(unit.size() != rank)
+		{
+			diagnostic.error = ERROR_UNIT;
+			return diagnostic;
+		}
+		
+		uint64_t mask = 0;
+		for(uint8_t i = 0; i < rank; ++i)
 		{
-			const uint8_t& blockIndex = blockIndices[position];
-			if(blockIndex != b)
+			const int32_t& position = unit[i];
+			if(position < 0 || position >= positionCount || std::find(unit.begin(), unit.begin() + i, position) != unit.begin() + i)
+			{
+				diagnostic.error = ERROR_UNIT;
+				return diagnostic;
+			}
+			
+			const uint8_t number = parseLetter(states[position]);
+			if(number == INVALID_NUMBER)
 				continue;
 			
-			// number start from 1.
-			FAST_FAIL(state[position], GROUP_TEXT[BLOCK], int16_t(b));
+			const uint64_t bit = uint64_t(1) << (number - 1);
+			if(mask & bit)
+			{
+				diagnostic.error = ERROR_DUPLICATE;
+				diagnostic.number = number;
+				diagnostic.row = position / rank;
+				diagnostic.column = position % rank;
+				return diagnostic;
+			}
+			mask |= bit;
 		}
 	}
 	
-#undef FAST_FAIL
+	diagnostic.group = NONE;
+	diagnostic.index = 0;
+	return diagnostic;
+}
+
+const Sudoku::Diagnostic& Sudoku::throwIfInvalid(const Diagnostic& diagnostic) noexcept(false)
+{
+	if(diagnostic.error != ERROR_NONE)
+		throw std::invalid_argument(describe(diagnostic));
+	
+	return diagnostic;
 }
 
-bool Sudoku::isBlockPartitionValid() const
+std::string Sudoku::describe(const Diagnostic& diagnostic)
 {
-	std::vector<uint8_t> accumulator(1 + rank);  // index 0 is unused here
-	for(int32_t i = 0; i < rank * rank; ++i)
+	std::ostringstream os;
+	switch(diagnostic.error)
 	{
-		const uint8_t& index = blockIndices[i];
-		if(index <= 0 || index > rank)
-			return false;
-		
-		++accumulator[index];
+	case ERROR_NONE:
+		os << "no error";
+		break;
+	case ERROR_RANK:
+		os << "invalid rank";
+		break;
+	case ERROR_LETTER:
+		os << "invalid letter at position " << '(' << int16_t(diagnostic.row) << ", " << int16_t(diagnostic.column) << ')';
+		break;
+	case ERROR_BLOCK_PARTITION:
+		os << "invalid block partition";
+		if(diagnostic.index != 0)
+			os << ", " << GROUP_TEXT[BLOCK] << ' ' << int16_t(diagnostic.index) << " doesn't have rank cells";
+		else
+			os << " at position " << '(' << int16_t(diagnostic.row) << ", " << int16_t(diagnostic.column) << ')';
+		break;
+	case ERROR_DUPLICATE:
+		os << "found duplicate value "
+				<< '\'' << toLetter(diagnostic.number) << '\''
+				<< " on " << GROUP_TEXT[diagnostic.group] << ' ' << int16_t(diagnostic.index);
+		break;
+	case ERROR_UNIT:
+		os << "invalid " << GROUP_TEXT[EXTRA] << " unit " << int16_t(diagnostic.index)
+				<< ", it should have rank different cells";
+		break;
 	}
 	
-//	assert(accumulator[0] == 0);  // blocks are one base indexed
-	for(uint8_t i = 1; i <= rank; ++i)
-		if(accumulator[i] != rank)
-			return false;
-	
-	return true;
+	return os.str();
 }
 
 uint8_t Sudoku::getRank() const
@@ -223,19 +551,37 @@ uint8_t Sudoku::getRank() const
 	return rank;
 }
 
-int32_t Sudoku::getMapPosition(uint8_t blockIndex, uint8_t number) const
+int32_t Sudoku::getBlockUnit(uint8_t blockIndex) const
 {
 	assert(0 < blockIndex && blockIndex <= rank);
+	return 2 * rank + blockIndex - 1;
+}
+
+bool Sudoku::isPlaced(int32_t unit, uint8_t number) const
+{
+	assert(0 <= unit && unit < unitCount);
 	assert(0 < number && number <= rank);
-	return map[(blockIndex - 1) * rank + (number - 1)];
+	return (placedMasks[unit] >> (number - 1)) & 1;
 }
 
-void Sudoku::setMapPosition(uint8_t blockIndex, uint8_t number, int32_t position)
+uint64_t Sudoku::getLocationMask(int32_t unit, uint8_t number) const
 {
-	assert(0 < blockIndex && blockIndex <= rank);
+	assert(0 <= unit && unit < unitCount);
 	assert(0 < number && number <= rank);
-	assert(0 <= position && position < rank * rank);
-	map[(blockIndex - 1) * rank + (number - 1)] = position;
+	return locations[unit * rank + number - 1];
+}
+
+uint64_t Sudoku::projectBlock(uint8_t blockIndex, uint8_t number, bool horizontal) const
+{
+	const int32_t blockUnit = getBlockUnit(blockIndex);
+	const int32_t* blockCells = units.data() + blockUnit * rank;
+	uint64_t lines = 0;
+	for(uint64_t mask = getLocationMask(blockUnit, number); mask != 0; mask &= mask - 1)
+	{
+		const int32_t& position = blockCells[lowestBit(mask)];
+		lines |= uint64_t(1) << (horizontal? position / rank: position % rank);
+	}
+	return lines;
 }
 
 void Sudoku::setNumber(int32_t position, uint8_t number)
@@ -278,45 +624,31 @@ void Sudoku::updateNumber(int32_t position, uint8_t number)
 	assert(0 <= position && position < rank * rank);
 	assert(0 < number && number <= rank);
 	
-	uint8_t row    = position / rank;
-	uint8_t column = position % rank;
-	
-	// remove possibility of value in the same row
-	for(uint8_t r = 0; r < rank; ++r)
-	{
-		int32_t position = r * rank + column;
-		if(r == row || field[position] != INVALID_NUMBER)
-			continue;
-		
-		removeCandidate(position, number);
-	}
-	
-	// remove possibility of value in the same column
-	int32_t base = row * rank;
-	for(uint8_t c = 0; c < rank; ++c)
+	// the cell leaves the blank cells, take its candidates away.
+	const std::vector<int32_t>& unitsOfCell = cellUnits[position];
+	const std::vector<uint8_t>& seatsOfCell = cellSeats[position];
+	const uint64_t mask = candidates[position];
+	for(size_t i = 0; i < unitsOfCell.size(); ++i)
 	{
-		int32_t position = base + c;
-		if(c == column || field[position] != INVALID_NUMBER)
-			continue;
+		const int32_t& unit = unitsOfCell[i];
+		for(uint64_t m = mask; m != 0; m &= m - 1)
+			locations.remove(unit * rank + lowestBit(m), uint64_t(1) << seatsOfCell[i]);
 		
-		removeCandidate(position, number);
+		placedMasks.add(unit, uint64_t(1) << (number - 1));
+		--remaining[unit];
 	}
+	candidateCount -= bitCount(mask);
+	candidates.set(position, 0);
+	--blankCount;
 	
-	// remove possibility of value in the same block.
-	const uint8_t& blockIndex = blockIndices[position];
-	for(std::pair<const int32_t, std::vector<uint8_t>>& blank: blankCandidates)
+	// remove possibility of value in the same row, column, block and extra units.
+	for(const int32_t& unit: unitsOfCell)
+	for(uint8_t i = 0; i < rank; ++i)
 	{
-		const int32_t& position = blank.first;
-		if(blockIndices[position] == blockIndex)
-		{
-			std::vector<uint8_t>& candidates = blank.second;
-			removeElement(candidates, number);
-		}
+		const int32_t& peer = units[unit * rank + i];
+		if(field[peer] == INVALID_NUMBER)
+			removeCandidate(peer, number);
 	}
-	
-	blankCandidates.erase(position);
-	removeElement(blankBlocks[blockIndex], position);
-	setMapPosition(blockIndices[position], number, position);
 }
 
 bool Sudoku::isSafe() const
@@ -371,6 +703,21 @@ bool Sudoku::isSafe() const
 		}
 	}
 	
+	// check whether EXTRA group conflicts
+	for(int32_t unit = 3 * rank; unit < unitCount; ++unit)
+	{
+		std::fill(flags, flags + RANK_MAX, false);
+		for(uint8_t i = 0; i < rank; ++i)
+		{
+			int32_t position = units[unit * rank + i];
+			uint8_t number = getNumber(position);
+			if(number == INVALID_NUMBER)
+				continue;
+			
+			FAST_FAIL(number - 1);
+		}
+	}
+	
 #undef FAST_FAIL
 	return true;
 }
@@ -381,26 +728,7 @@ bool Sudoku::isSafe(uint8_t row, uint8_t column, uint8_t number) const
 	assert(0 <= column && column < rank);
 	assert(0 < number && number <= rank);
 	
-	int32_t position = row * rank + column;
-	if(getNumber(position) != INVALID_NUMBER)  // this seat is already taken.
-		return false;
-	
-	// check the row line
-	for(int32_t c = 0; c < rank; ++c)
-		if(getNumber(row, c) == number)  // getNumber(row, column) == 0, number > 0
-			return false;
-			
-	// check the column line
-	for(int32_t r = 0; r < rank; ++r)
-		if(getNumber(r, column) == number)  // getNumber(row, column) == 0, number > 0
-			return false;
-	
-	// check the block that belongs.
-	const uint8_t& blockIndex = blockIndices[position];
-	if(getMapPosition(blockIndex, number) != INVALID_POSTION)
-		return false;
-	
-	return true;
+	return isSafe(static_cast<int32_t>(row * rank + column), number);
 }
 
 bool Sudoku::isSafe(int32_t position, uint8_t number) const
@@ -411,21 +739,11 @@ bool Sudoku::isSafe(int32_t position, uint8_t number) const
 	if(getNumber(position) != INVALID_NUMBER)  // this seat is already taken.
 		return false;
 	
-	// check the row line
-	for(int32_t p = position / rank * rank, end = p + rank; p < end; ++p)
-		if(getNumber(p) == number)  // getNumber(row, column) == 0, number > 0
+	// check the row, column, block and extra units that it belongs to.
+	for(const int32_t& unit: cellUnits[position])
+		if(isPlaced(unit, number))
 			return false;
 	
-	// check each column,
-	for(int32_t p = position % rank, end = rank * rank; p < end; p += rank)
-		if(getNumber(p) == number)  // getNumber(row, column) == 0, number > 0
-			return false;
-	
-	// check the block that belongs.
-	const uint8_t& blockIndex = blockIndices[position];
-	if(getMapPosition(blockIndex, number) != INVALID_POSTION)
-		return false;
-	
 	return true;
 }
 
@@ -433,15 +751,12 @@ std::vector<std::pair<int32_t, uint8_t>> Sudoku::findNakedSingle() const
 {
 	std::vector<std::pair<int32_t, uint8_t>> steps;
 	
-	for(const std::pair<int32_t, std::vector<uint8_t>>& blank: blankCandidates)
+	const int32_t rankSquared = rank * rank;
+	for(int32_t position = 0; position < rankSquared; ++position)
 	{
-		const std::vector<uint8_t>& candidates = blank.second;
-		if(candidates.size() == 1)
-		{
-			const int32_t& position = blank.first;
-			const uint8_t& number = *candidates.begin();
-			steps.emplace_back(std::make_pair(position, number));
-		}
+		const uint64_t mask = candidates[position];
+		if(mask != 0 && (mask & (mask - 1)) == 0)
+			steps.emplace_back(std::make_pair(position, static_cast<uint8_t>(lowestBit(mask) + 1)));
 	}
 	
 	return steps;
@@ -450,104 +765,66 @@ std::vector<std::pair<int32_t, uint8_t>> Sudoku::findNakedSingle() const
 std::vector<std::pair<int32_t, uint8_t>> Sudoku::findHiddenSingle() const
 {
 	std::vector<std::pair<int32_t, uint8_t>> steps;
-
-	int32_t positions[1 + RANK_MAX];
-	uint8_t histogram[1 + RANK_MAX];
-	
-	auto reset = [&positions, &histogram]()
-	{
-		std::fill(positions, positions + (1 + RANK_MAX), INVALID_POSTION);
-		std::fill(histogram, histogram + (1 + RANK_MAX), 0);
-	};
-	
-	const auto& field = this->field;
-	const auto& blankCandidates = this->blankCandidates;
-	auto handlePosition = [&positions, &histogram, &field, &blankCandidates](int32_t position)
-	{
-		if(field[position] != INVALID_NUMBER)
-			return;
-			
-		const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-		for(const uint8_t& candidate: candidates)
-		{
-			++histogram[candidate];
-			positions[candidate] = position;
-		}
-	};
 	
-	const auto& rank = this->rank;
-	auto addSingle = [&positions, &histogram, &rank, &steps](Group group, uint8_t index)
+	// units are visited in order of rows, columns, blocks and extra units. A full filled unit has no
+	// location left, so it's skipped naturally.
+	for(int32_t unit = 0; unit < unitCount; ++unit)
 	{
 		for(uint8_t n = 1; n <= rank; ++n)
 		{
-			if(histogram[n] != 1)
+			const uint64_t mask = locations[unit * rank + n - 1];
+			if(mask == 0 || (mask & (mask - 1)) != 0)
 				continue;
 			
-			const int32_t& position = positions[n];
+			const int32_t position = units[unit * rank + lowestBit(mask)];
 			steps.emplace_back(std::make_pair(position, n));
-			std::cout << GROUP_TEXT[group] << ' ' << int16_t(index)
-					<< " has hidden single candidate " << '\'' << toLetter(n) << '\''
-					<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
-		}
-	};
-	
-	// for each row
-	for(uint8_t r = 0; r < rank; ++r)
-	{
-		reset();
-		
-		const int32_t base = r * rank;
-		for(uint8_t c = 0; c < rank; ++c)
-		{
-			int32_t position = base + c;
-			handlePosition(position);
-		}
-		
-		addSingle(ROW, r);
-	}
-	
-	// for each column
-	for(uint8_t c = 0; c < rank; ++c)
-	{
-		reset();
-		for(uint8_t r = 0; r < rank; ++r)
-		{
-			int32_t position = r * rank + c;
-			handlePosition(position);
+			if(verbose)
+				std::cout << getUnitText(unit)
+						<< " has hidden single candidate " << '\'' << toLetter(n) << '\''
+						<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
 		}
-		
-		addSingle(COLUMN, c);
 	}
 	
-	// for each block
-	for(uint8_t b = 1; b <= rank; ++b)
-	{
-		const std::vector<int32_t>& blankBlock = blankBlocks[b];
-		if(blankBlock.empty())  // this block is full filled.
-			continue;
-		
-		reset();
-		for(const int32_t position: blankBlock)
-			handlePosition(position);
-		addSingle(BLOCK, b);
-	}
-
 	return steps;
 }
 
-const std::map<int32_t, std::vector<uint8_t>>& Sudoku::getBlankCandidates() const
+uint64_t Sudoku::getCandidateMask(int32_t position) const
 {
-	return blankCandidates;
+	assert(0 <= position && position < rank * rank);
+	return candidates[position];
+}
+
+std::string Sudoku::getUnitText(int32_t unit) const
+{
+	assert(0 <= unit && unit < unitCount);
+	std::ostringstream os;
+	if(unit < rank)
+		os << GROUP_TEXT[ROW] << ' ' << unit;
+	else if(unit < 2 * rank)
+		os << GROUP_TEXT[COLUMN] << ' ' << unit - rank;
+	else if(unit < 3 * rank)
+		os << GROUP_TEXT[BLOCK] << ' ' << unit - 2 * rank + 1;  // block index is one-based.
+	else
+		os << GROUP_TEXT[EXTRA] << ' ' << unit - 3 * rank;
+	return os.str();
 }
 
 bool Sudoku::removeCandidate(int32_t position, uint8_t number)
 {
 	assert(0 <= position && position < rank * rank);
 	assert(0 < number && number <= rank);
-	assert(blankCandidates.find(position) != blankCandidates.end());
 	
-	std::vector<uint8_t>& candidates = blankCandidates[position];
-	return removeElement(candidates, number);
+	const uint64_t bit = uint64_t(1) << (number - 1);
+	if((candidates[position] & bit) == 0)
+		return false;
+	
+	candidates.remove(position, bit);
+	const std::vector<int32_t>& unitsOfCell = cellUnits[position];
+	const std::vector<uint8_t>& seatsOfCell = cellSeats[position];
+	for(size_t i = 0; i < unitsOfCell.size(); ++i)
+		locations.remove(unitsOfCell[i] * rank + number - 1, uint64_t(1) << seatsOfCell[i]);
+	--candidateCount;
+	return true;
 }
 
 /*
@@ -556,199 +833,92 @@ bool Sudoku::removeCandidate(int32_t position, uint8_t number)
  * It is clear that the solution will contain those numbers in those two cells (we just don’t know 
  * which is which at this stage) and all other candidates with those numbers can be crossed out from
  * whatever group they have in common.
+ *
+ * We can certainly extend Naked Pairs to Naked Triples. Any three cells in the same group that 
+ * contain the same three candidate numbers will be a Naked Triple. The rest of the group can be 
+ * crossed out any of those numbers.
+ *
+ * But a Naked Triple is much more versatile than this rule implies. In fact it is not necessary for
+ * there to be three candidates in each cell. As long as there are in total three candidates in 
+ * three cells. Obviously we’re not going to apply this rule to single candidate cells – since they 
+ * are solved, so the possible combinations are as follows:
+ * (123) (123) (123)  - {3/3/3} (in terms of candidates per cell)
+ * (123) (123) (12)   - {3/3/2} (or some combination thereof)
+ * (123) (12)  (23)   - {3/2/2}
+ * (12)  (23)  (13)   - {2/2/2}
  */
-void Sudoku::updateCandidateByNakedPair()
+void Sudoku::updateCandidateByNakedSubset(uint8_t size)
 {
-	std::vector<uint32_t> values;  // naked pair candidates.
-
-#if __cplusplus >= 201703L // structured binding is added in C++17
-	for(const auto& [position, candidates]: blankCandidates)
-	{
-#else
-	for(const std::pair<int32_t, std::vector<uint8_t>>& blank: blankCandidates)
-	{
-		const int32_t& position = blank.first;
-		const std::vector<uint8_t>& candidates = blank.second;
-#endif
-		if(candidates.size() != 2)
-			continue;
-		
-		assert(0 <= position && position < rank * rank);
-		uint8_t row = position / rank;
-		uint8_t column = position % rank;
-		assert(candidates[0] < candidates[1]);
-		uint32_t value = (column << 24) | (row << 16) | (candidates[1] << 8) | candidates[0];
-//		assert(candidates[0] < candidates[1]);
-		values.emplace_back(value);
-	}
-
-	std::unordered_map<uint32_t, uint32_t> keyValues;
-	keyValues.reserve(values.size());
+	assert(2 <= size && size <= 3);
+	static const char* SUBSET_TEXT[4] = {"", "", "pair", "triple"};
 	
-	// statistics about the paired candidates.
-	for(const uint32_t& value: values)
-	{
-		const uint32_t key = value & 0x0000FFFF;  // (candidates[1], candidates[0]) pair.
-		auto it = keyValues.find(key);
-		if(it == keyValues.end())
-			keyValues.emplace(std::make_pair(key, 1));
-		else
-		{
-			uint32_t& count = it->second;
-			++count;
-		}
-	}
-	
-	// evict those paired candidates that only appears once.
-	std::vector<uint32_t> pairedValues;
-	for(const uint32_t& value: values)
-	{
-		const uint32_t key = value & 0x0000FFFF;  // (candidates[1], candidates[0]) pair.
-		auto it = keyValues.find(key);
-		const uint32_t& count = it->second;
-		if(count >= 2)
-			pairedValues.emplace_back(value);
-	}
-	values = std::move(pairedValues);
+	int32_t positions[RANK_MAX];
+	uint64_t masks[RANK_MAX];
+	uint8_t indices[3];
 	
-	keyValues.clear();
-	for(const uint32_t& value: values)
+	for(int32_t unit = 0; unit < unitCount; ++unit)
 	{
-		assert(value != 2);
-		const uint32_t key = value & 0x00FFFFFF;  // (row, candidates[1], candidates[0]) triple.
-		auto it = keyValues.find(key);
-		if(it == keyValues.end())
-			keyValues.emplace(std::make_pair(key, value));
-		else  // naked pair found
+		const int32_t* cells = &units[unit * rank];
+		uint8_t count = 0;
+		for(uint8_t i = 0; i < rank; ++i)
 		{
-			const uint8_t* byte = reinterpret_cast<const uint8_t*>(&value);
-			uint8_t candidate0 = byte[0];
-			uint8_t candidate1 = byte[1];
-			uint8_t row     = byte[2];
-			uint8_t column0 = byte[3];
-			uint8_t column1 = reinterpret_cast<const uint8_t*>(&it->second)[3];
-			assert(column0 != column1);
+			const int32_t& position = cells[i];
+			if(field[position] != INVALID_NUMBER)
+				continue;
 			
-			int32_t base = row * rank;
-			for(uint8_t c = 0; c < rank; ++c)
+			const uint64_t mask = getCandidateMask(position);
+			const uint8_t seat = bitCount(mask);
+			if(2 <= seat && seat <= size)
 			{
-				if(c == column0 || c == column1)
-					continue;
-					
-				int32_t position = base + c;
-				if(field[position] != INVALID_NUMBER)
-					continue;
-				
-				auto removeCandidateAndPrint = [&](const uint8_t& number)
-				{
-					if(!removeCandidate(position, number))
-						return;
-					
-					std::cout << "naked pair candidates "
-							<< '{' << toLetter(candidate0) << ", " << toLetter(candidate1) << '}'
-							<< " found in " << GROUP_TEXT[ROW] << ' ' << int16_t(row) << ' '
-							<< GROUP_TEXT[ROW] << ' ' << int16_t(column0) << " and " << int16_t(column1)
-							<< ", remove candidate " << '\'' << toLetter(number) << '\''
-							<< " at position " << '(' << int16_t(row) << ", " << int16_t(c) << ')' << '\n';
-				};
-				
-				removeCandidateAndPrint(candidate0);
-				removeCandidateAndPrint(candidate1);
-			};
+				positions[count] = position;
+				masks[count] = mask;
+				++count;
+			}
 		}
-	}
-	
-	keyValues.clear();
-	for(const int32_t& value: values)
-	{
-		const uint32_t key = value & 0xFF00FFFF;  // (column, candidates[1], candidates[0]) triple.
-		auto it = keyValues.find(key);
-		if(it == keyValues.end())
-			keyValues.emplace(std::make_pair(key, value));
-		else  // naked pair found
+		
+		if(count < size)
+			continue;
+		
+		for(uint8_t i = 0; i < size; ++i)
+			indices[i] = i;
+		
+		do
 		{
-			const uint8_t* byte = reinterpret_cast<const uint8_t*>(&value);
-			const uint8_t& candidate0 = byte[0];
-			const uint8_t& candidate1 = byte[1];
-			const uint8_t& row0    = byte[2];
-			const uint8_t& row1    = reinterpret_cast<const uint8_t*>(&it->second)[2];
-			const uint8_t& column  = byte[3];
-			assert(row0 != row1);
-
-			for(uint8_t r = 0; r < rank; ++r)
+			uint64_t subset = 0;
+			for(uint8_t i = 0; i < size; ++i)
+				subset |= masks[indices[i]];
+			
+			if(bitCount(subset) != size)  // naked subset has as many numbers as cells.
+				continue;
+			
+			for(uint8_t i = 0; i < rank; ++i)
 			{
-				if(r == row0 || r == row1)
-					continue;
-					
-				int32_t position = r * rank + column;
+				const int32_t& position = cells[i];
 				if(field[position] != INVALID_NUMBER)
 					continue;
 				
-				auto removeCandidateAndPrint = [&](const uint8_t& number)
-				{
-					if(!removeCandidate(position, number))
-						return;
-					
-					std::cout << "naked pair candidates "
-							<< '{' << toLetter(candidate0) << ", " << toLetter(candidate1) << '}'
-							<< " found in " << GROUP_TEXT[COLUMN] << ' ' << int16_t(column) << ' '
-							<< GROUP_TEXT[ROW] << ' ' << int16_t(row0) << " and " << int16_t(row1)
-							<< ", remove candidate " << '\'' << toLetter(number) << '\''
-							<< " at position " << '(' << int16_t(r) << ", " << int16_t(column) << ')' << '\n';
-				};
-				
-				removeCandidateAndPrint(candidate0);
-				removeCandidateAndPrint(candidate1);
-			};
-		}
-	}
-	
-	keyValues.clear();
-	for(const uint32_t& value: values)  // high <- column | row | candidate1 | candidate0 -> low
-	{
-		uint32_t row = static_cast<uint8_t>(value >> 16), column = static_cast<uint8_t>(value >> 24);
-		uint32_t position = row * rank + column;
-		uint8_t blockIndex = blockIndices[position];
-		uint8_t number = field[position];
-		uint32_t newValue = (number << 24) | (blockIndex << 16) | (value & 0x0000FFFF);
-		
-		const uint32_t key = newValue & 0x00FFFFFF;  // (block, candidate1, candidate0) triple.
-		auto it = keyValues.find(key);
-		if(it == keyValues.end())
-			keyValues.emplace(std::make_pair(key, newValue));
-		else  // naked pair found
-		{
-			const uint8_t* byte = reinterpret_cast<const uint8_t*>(&value);
-			const uint8_t& candidate0 = byte[0];
-			const uint8_t& candidate1 = byte[1];
-			const uint8_t& blockIndex = byte[2];
-			const uint8_t& number0 = byte[3];
-			const uint8_t& number1 = reinterpret_cast<const uint8_t*>(&it->second)[3];
-//			assert(number0 != number1);
-
-			const std::vector<int32_t>& blockGroup = blankBlocks[blockIndex];
-			for(const int32_t& position: blockGroup)
-			{
-				const uint8_t& number = field[position];
-				if(number == INVALID_NUMBER || number == number0 || number == number1)
+				bool inSubset = false;
+				for(uint8_t j = 0; j < size; ++j)
+					inSubset = inSubset || positions[indices[j]] == position;
+				if(inSubset)
 					continue;
 				
-				auto removeCandidateAndPrint = [&](const uint8_t& number)
+				for(uint64_t mask = subset; mask != 0; mask &= mask - 1)
 				{
-					if(!removeCandidate(position, number))
-						return;
+					const uint8_t number = lowestBit(mask) + 1;
+					if(!removeCandidate(position, number) || !verbose)
+						continue;
 					
-					std::cout << "naked pair candidates "
-							<< '{' << toLetter(candidate0) << ", " << toLetter(candidate1) << '}'
-							<< " found in " << GROUP_TEXT[BLOCK] << ' ' << int16_t(blockIndex)
+					std::cout << "naked " << SUBSET_TEXT[size] << ' ' << '{';
+					for(uint64_t m = subset; m != 0; m &= m - 1)
+						std::cout << toLetter(lowestBit(m) + 1) << ((m & (m - 1))? ", ": "");
+					std::cout << '}' << " in " << getUnitText(unit)
 							<< ", remove candidate " << '\'' << toLetter(number) << '\''
 							<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
-				};
-				
-				removeCandidateAndPrint(candidate0);
-				removeCandidateAndPrint(candidate1);
-			};
+				}
+			}
 		}
+		while(nextCombination(indices, size, count));
 	}
 }
 
@@ -757,134 +927,6 @@ void Sudoku::updateCandidateByHiddenPair()
 	// TODO:
 }
 
-/*
- * We can certainly extend Naked Pairs to Naked Triples. Any three cells in the same group that 
- * contain the same three candidate numbers will be a Naked Triple. The rest of the group can be 
- * crossed out any of those numbers.
- *
- * But a Naked Triple is much more versatile than this rule implies. In fact it is not necessary for
- * there to be three candidates in each cell. As long as there are in total three candidates in 
- * three cells. Obviously we’re not going to apply this rule to single candidate cells – since they 
- * are solved, so the possible combinations are as follows:
- * (123) (123) (123)  - {3/3/3} (in terms of candidates per cell)
- * (123) (123) (12)   - {3/3/2} (or some combination thereof)
- * (123) (12)  (23)   - {3/2/2}
- * (12)  (23)  (13)   - {2/2/2}
- */
-void Sudoku::updateCandidateByNakedTriple()
-{
-	std::vector<int32_t> positions;
-
-#if __cplusplus >= 201703L // structured binding is added in C++17
-	for(const auto& [position, candidates]: blankCandidates)
-	{
-#else
-	for(const std::pair<int32_t, std::vector<uint8_t>>& blank: blankCandidates)
-	{
-		const int32_t& position = blank.first;
-		const std::vector<uint8_t>& candidates = blank.second;
-#endif
-		uint8_t size = static_cast<uint8_t>(candidates.size());  // at most rank
-		if(size < 2 || size > 3)
-			continue;
-		
-		positions.emplace_back(position);
-	}
-	
-	// For three given position, judge whether they forms a group.
-	const uint8_t& rank = this->rank;
-	const std::vector<uint8_t>& blockIndices = this->blockIndices;
-	auto getGroup = [&rank, &blockIndices](uint32_t position0, uint32_t position1, uint32_t position2) -> uint16_t
-	{
-		assert(position0 != position1 && position1 != position2);
-		uint8_t bytes[4] = {0, uint8_t(position0 / rank), uint8_t(position0 % rank), blockIndices[position0]};
-		const uint8_t& r = bytes[ROW];
-		const uint8_t& c = bytes[COLUMN];
-		const uint8_t& b = bytes[BLOCK];
-		
-		Group group;
-		if(position1 / rank == r && position2 / rank == r)
-			group = ROW;
-		else if(position1 % rank == c && position2 % rank == c)
-			group = COLUMN;
-		else if(blockIndices[position1] == b && blockIndices[position2] == b)
-			group = BLOCK;
-		else
-			group = NONE;
-		
-		return bytes[group] << 8 | group;
-	};
-	
-	uint8_t size = static_cast<uint8_t>(positions.size());
-	for(uint8_t i = 0;     i < size; ++i)
-	for(uint8_t j = i + 1; j < size; ++j)
-	for(uint8_t k = j + 1; k < size; ++k)
-	{
-		const int32_t& position0 = positions[i];
-		const int32_t& position1 = positions[j];
-		const int32_t& position2 = positions[k];
-		
-		const uint16_t& groupInfo = getGroup(position0, position1, position2);
-		Group group = static_cast<Group>(groupInfo & 0xFF);
-		uint8_t groupIndex = groupInfo >> 8;
-		if(group == NONE)
-			continue;
-		
-		std::set<uint8_t> candidates;
-//		candidates.reserve(rank);
-		for(const uint8_t& candidate: blankCandidates[position0])
-			candidates.emplace(candidate);
-		for(const uint8_t& candidate: blankCandidates[position1])
-			candidates.emplace(candidate);
-		for(const uint8_t& candidate: blankCandidates[position2])
-			candidates.emplace(candidate);
-		
-		if(candidates.size() != 3)
-			continue;
-		
-		uint8_t numbers[3];  // naked triple found
-		std::copy(candidates.begin(), candidates.end(), numbers);
-//		sort(numbers);  // changed from std::unordered_set to std::set, std::set container is ordered.
-		
-		auto removeCandidateAndPrint = [&, this](int32_t position)
-		{
-			if(field[position] != INVALID_NUMBER)
-				return;
-			
-			if(position == position0 || position == position1 || position == position2)
-				return;
-				
-			for(uint8_t m = 0; m < 3; ++m)
-			{
-				const uint8_t& number = numbers[m];
-				if(!removeCandidate(position, number))
-					continue;
-				
-				std::cout << "naked triple " << '{'
-						<< toLetter(numbers[0]) << ", " <<  toLetter(numbers[1]) << ", " << toLetter(numbers[2])
-						<< '}' << " in " << GROUP_TEXT[group] << ' ' << int16_t(groupIndex)
-						<< ", remove candidate " << '\'' << toLetter(number) << '\''
-						<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
-			}
-		};
-		
-		if(group == BLOCK)
-		{
-			const std::vector<int32_t>& blockGroup = blankBlocks.at(groupIndex);
-			for(const int32_t& position: blockGroup)
-				removeCandidateAndPrint(position);
-		}
-		else
-		{
-			for(uint8_t l = 0; l < rank; ++l)
-			{
-				int32_t position = (group == ROW) ? (groupIndex * rank + l): (groupIndex + rank * l);
-				removeCandidateAndPrint(position);
-			}
-		}
-	}
-}
-
 /*
  * Check whether the candidate of one blank block forms one line(row or column), 
  * If so, extra restriction can be added to other blank blocks who intersects this line.
@@ -893,56 +935,32 @@ void Sudoku::updateCandidateOutBlockOfLine()
 {
 	for(uint8_t b = 1; b <= rank; ++b)
 	{
-		const std::vector<int32_t>& blockGroup = blankBlocks[b];
-		if(blockGroup.size() < 2)  // at least two points form a line.
+		const int32_t blockUnit = getBlockUnit(b);
+		if(remaining[blockUnit] < 2)  // at least two points form a line.
 			continue;
 		
 		// looking for intersection value
 		for(uint8_t n = 1; n <= rank; ++n)
 		{
-			if(getMapPosition(b, n) >= 0)  // skip values that used.
+			if(isPlaced(blockUnit, n))  // skip values that used.
 				continue;
 
-			int32_t row = 0, column = 0;
-			bool sameRow = true, sameColumn = true, first = true;
-			for(const int32_t& position: blockGroup)
-			{
-				assert(0 <= position && position < rank * rank);
-				const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-				auto it = std::find(candidates.begin(), candidates.end(), n);
-				if(it != candidates.end())
-				{
-					if(first)
-					{
-						row    = position / rank;
-						column = position % rank;
-						first  = false;
-					}
-					else
-					{
-						if(sameRow && position / rank != row)
-							sameRow = false;
-			
-						if(sameColumn && position % rank != column)
-							sameColumn = false;
-			
-						if(!sameRow && !sameColumn)  // [[likely]], fast quit
-							break;
-					}
-				}
-			}
+			const uint64_t rows    = projectBlock(b, n, true);
+			const uint64_t columns = projectBlock(b, n, false);
+			const bool sameRow    = rows    != 0 && (rows    & (rows    - 1)) == 0;
+			const bool sameColumn = columns != 0 && (columns & (columns - 1)) == 0;
 			
-			// Apparently, they can be the same row and the same column at the same time.
-			// If they never enter the for loop above, they will stay inital state (true).
+			// Apparently, a single candidate is in the same row and the same column at the same time.
 			if(sameRow == sameColumn)
 				continue;
 			
+			const int32_t row = lowestBit(rows), column = lowestBit(columns);
 			for(uint8_t k = 0; k < rank; ++k)
 			{
 				int32_t position = sameRow? (row * rank + k): (k * rank + column);
 				if(field[position] == INVALID_NUMBER && blockIndices[position] != b)
 				{
-					if(!removeCandidate(position, n))
+					if(!removeCandidate(position, n) || !verbose)
 						continue;
 					
 					std::cout << "in block " << int16_t(b) << ", candidate value "
@@ -975,189 +993,233 @@ void Sudoku::updateCandidateInBlockOutOfLine(bool horizontal)
 	for(uint8_t i = 0; i <  rank; ++i)  // i is row if horizontal else column
 	for(uint8_t n = 1; n <= rank; ++n)
 	{
-		uint8_t blockIndex = 0, j = 0;
-		for(; j < rank; ++j)  // j is column if horizontal else row
+		// j is the seat of the line, namely column if horizontal else row.
+		uint8_t blockIndex = 0;
+		for(uint64_t mask = getLocationMask(horizontal? i: rank + i, n); mask != 0; mask &= mask - 1)
 		{
-			int32_t position = horizontal? (i * rank + j): (i + rank * j);
-			if(field[position] != INVALID_NUMBER)
-				continue;
-			
-			const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-			auto it = std::find(candidates.begin(), candidates.end(), n);
-			if(it != candidates.end())
+			const uint8_t j = lowestBit(mask);
+			const uint8_t& index = blockIndices[horizontal? (i * rank + j): (i + rank * j)];
+			if(blockIndex != index)
 			{
-				const uint8_t& index = blockIndices[position];
-				if(blockIndex != index)
+				if(blockIndex != 0)  // when first time in, blockIndex == 0
 				{
-					if(blockIndex != 0)  // when first time in, blockIndex == 0
-					{
-						blockIndex = 0;
-						break;
-					}
-					blockIndex = index;
+					blockIndex = 0;
+					break;
 				}
+				blockIndex = index;
 			}
 		}
 		
 		if(blockIndex > 0)  // same block index
 		{
-			for(const std::pair<int32_t, std::vector<uint8_t>>& blank: blankCandidates)
+			const int32_t* blockCells = units.data() + getBlockUnit(blockIndex) * rank;
+			for(uint8_t k = 0; k < rank; ++k)
 			{
-				const int32_t& position = blank.first;
+				const int32_t& position = blockCells[k];
 				uint8_t lineIndex = horizontal? position / rank : position % rank;
-				if(blockIndices[position] == blockIndex && lineIndex != i)
+				if(field[position] == INVALID_NUMBER && lineIndex != i)
 				{
 					if(!removeCandidate(position, n))
 						return;
 					
-					std::cout << GROUP_TEXT[horizontal?ROW:COLUMN] << ' ' << int16_t(i)
-							<< " must feed letter " << '\'' << toLetter(n) << '\''
-							<< " in block " << int16_t(blockIndex) << ", so remove candidate " << '\'' << toLetter(n) << '\''
-							<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
+					if(verbose)
+						std::cout << GROUP_TEXT[horizontal?ROW:COLUMN] << ' ' << int16_t(i)
+								<< " must feed letter " << '\'' << toLetter(n) << '\''
+								<< " in block " << int16_t(blockIndex) << ", so remove candidate " << '\'' << toLetter(n) << '\''
+								<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
 				}
 			}
 		}
 	}
 }
 
+void Sudoku::getLineMasks(uint8_t number, bool horizontal, uint64_t* lines) const
+{
+	assert(0 < number && number <= rank);
+	
+	// seats of a row are ordered by column, and seats of a column by row.
+	const int32_t base = horizontal? 0: rank;
+	for(uint8_t i = 0; i < rank; ++i)
+		lines[i] = getLocationMask(base + i, number);
+}
+
 /*
  * An X-Wing pattern occurs when two rows (or two columns) each contain only two cells that hold a 
  * matching candidate. This candidate must reside in both rows and share the same two columns or 
  * vice versa.
+ *
+ * Swordfish and jellyfish are the same pattern with three and four lines. Each base line needn't
+ * have all the cover lines, only the union counts. Take number N in a swordfish for example,
+ *   row 1: | + . . | . + . | . . . |
+ *   row 4: | . . . | . + . | . . + |
+ *   row 7: | + . . | . . . | . . + |
+ * N must be in column 0, 4 and 8 of the three rows, other rows can cross out N in the three columns.
+ *
+ * If row 7 has another candidate N (a fin) at column 1, either the fin is N, or the fish stands.
+ * Both cases cross out N from cells which are in column 0, 4 and 8 and see the fin, namely cells of
+ * the fin's block. Fins can be more than one, as long as they are in one block.
  */
-void Sudoku::updateCandidateByXWing(bool horizontal)
+void Sudoku::updateCandidateByFish(uint8_t size, bool horizontal, bool finned)
 {
-	auto project = [&](uint8_t line, uint8_t number, bool horizontal) -> uint32_t
+	assert(2 <= size && size <= FISH_SIZE_MAX);
+	static const char* FISH_TEXT[1 + FISH_SIZE_MAX] = {"", "", "X-Wing", "swordfish", "jellyfish"};
+	const Group baseGroup  = horizontal? ROW: COLUMN;
+	const Group coverGroup = horizontal? COLUMN: ROW;
+	
+	// Fins sit in one block, and a block intersects a line with a few cells, limit it to make search
+	// space small.
+	const uint8_t maxSeat = finned? size + FIN_COUNT_MAX: size;
+	
+	uint64_t lines[RANK_MAX];
+	uint8_t candidateLines[RANK_MAX];
+	uint8_t bases[FISH_SIZE_MAX];
+	
+	auto printLines = [](const uint8_t* lines, uint8_t count) -> std::string
+	{
+		std::ostringstream os;
+		for(uint8_t i = 0; i < count; ++i)
+			os << (i == 0? "": (i + 1 == count? " and ": ", ")) << int16_t(lines[i]);
+		return os.str();
+	};
+	
+	auto printMask = [&printLines](uint64_t mask) -> std::string
+	{
+		uint8_t lines[RANK_MAX];
+		uint8_t count = 0;
+		for(; mask != 0; mask &= mask - 1)
+			lines[count++] = lowestBit(mask);
+		return printLines(lines, count);
+	};
+	
+	// remove candidate number from cover lines except base lines, block is 0 for all blocks.
+	auto removeCandidateAndPrint = [&](uint8_t number, uint64_t cover, uint8_t block, uint64_t fins)
 	{
-		constexpr uint8_t UNINITIALIZED = -1;
-		alignas(4) uint8_t lines[4] = {UNINITIALIZED, UNINITIALIZED, number, line};
-		// four bytes are line0, line1, number, line.
-		// if horizontal, it's column0, column1, number,    row;
-		//     otherwise, it's    row0,    row1, number, column.
+		uint64_t baseMask = 0;
+		for(uint8_t i = 0; i < size; ++i)
+			baseMask |= uint64_t(1) << bases[i];
 		
-		for(uint8_t i = 0; i < rank; ++i)  // i is row if horizontal else column
+		for(uint64_t mask = cover; mask != 0; mask &= mask - 1)
 		{
-			int32_t position = horizontal? (line * rank + i): (line + rank * i);
-			if(field[position] != INVALID_NUMBER)
-				continue;
-			
-			const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-			if(std::find(candidates.begin(), candidates.end(), number) != candidates.end())
+			uint8_t line = lowestBit(mask);
+			for(uint8_t i = 0; i < rank; ++i)
 			{
-				if(lines[0] == UNINITIALIZED)
-					lines[0] = i;
-				else if(lines[1] == UNINITIALIZED)
-					lines[1] = i;
-				else
-					return 0;
+				if((baseMask >> i) & 1)
+					continue;
+				
+				if(((lines[i] >> line) & 1) == 0)
+					continue;
+				
+				int32_t position = horizontal? (i * rank + line): (line * rank + i);
+				if(block != 0 && blockIndices[position] != block)
+					continue;
+				
+				if(!removeCandidate(position, number))
+					continue;
+				
+				lines[i] &= ~(uint64_t(1) << line);
+				if(!verbose)
+					continue;
+				
+				std::cout << GROUP_TEXT[baseGroup] << ' ' << printLines(bases, size)
+						<< " forms " << (block != 0? "a finned ": "a ") << FISH_TEXT[size]
+						<< " about letter " << '\'' << toLetter(number) << '\'' << " in "
+						<< GROUP_TEXT[coverGroup] << ' ' << printMask(cover);
+				if(block != 0)
+					std::cout << " with fin " << GROUP_TEXT[coverGroup] << ' ' << printMask(fins)
+							<< " in " << GROUP_TEXT[BLOCK] << ' ' << int16_t(block);
+				std::cout << ", remove candidate " << '\'' << toLetter(number) << '\''
+						<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
 			}
 		}
-		
-		if(lines[1] == UNINITIALIZED)  // less than two seats.
-			return 0;
-
-		return *reinterpret_cast<uint32_t*>(lines);
 	};
 	
-	std::vector<uint32_t> values;
-	values.reserve(rank * (rank + 1) / 2);
-	
-	for(uint8_t i = 0; i < rank; ++i)  // i is row if horizontal else column
-	for(uint8_t n = 1; n <= rank; ++n)
+	// All fins of base lines must be in one block, return that block, or 0 if not.
+	auto getFinBlock = [&](uint64_t cover) -> uint8_t
 	{
-		const uint32_t& value = project(i, n, horizontal);
-		if(value != 0)
-			values.emplace_back(value);
-	}
-	
-	std::unordered_map<uint32_t, uint32_t> keyValues;
-	keyValues.reserve(values.size());
+		uint8_t block = 0;
+		for(uint8_t i = 0; i < size; ++i)
+		{
+			const uint8_t& line = bases[i];
+			for(uint64_t fins = lines[line] & ~cover; fins != 0; fins &= fins - 1)
+			{
+				uint8_t cross = lowestBit(fins);
+				int32_t position = horizontal? (line * rank + cross): (cross * rank + line);
+				const uint8_t& index = blockIndices[position];
+				if(block == 0)
+					block = index;
+				else if(block != index)
+					return 0;
+			}
+		}
+		return block;
+	};
 	
-	for(const uint32_t& value: values)
+	for(uint8_t n = 1; n <= rank; ++n)
 	{
-		const uint32_t key = value & 0x00FFFFFF;  // (line0, line1, number) triple.
-		auto it = keyValues.find(key);
-		if(it == keyValues.end())
-			keyValues.emplace(std::make_pair(key, value));
-		else  // an X-Wing found
+		getLineMasks(n, horizontal, lines);
+		
+		uint8_t count = 0;
+		for(uint8_t i = 0; i < rank; ++i)
+		{
+			uint8_t seat = bitCount(lines[i]);
+			if(2 <= seat && seat <= maxSeat)
+				candidateLines[count++] = i;
+		}
+		
+		if(count < size)
+			continue;
+		
+		// enumerate combinations of base lines in lexicographical order.
+		uint8_t indices[FISH_SIZE_MAX];
+		for(uint8_t i = 0; i < size; ++i)
+			indices[i] = i;
+		
+		do
 		{
-			const uint8_t& line0 = *reinterpret_cast<const uint8_t*>(&key);        // column if horizontal
-			const uint8_t& line1 = *(reinterpret_cast<const uint8_t*>(&key) + 1);  // column if horizontal
-			const uint8_t& number= static_cast<uint8_t>(value >> 16);
-			const uint8_t& line2 = static_cast<uint8_t>(it->second >> 24);    // row if horizontal
-			const uint8_t& line3 = static_cast<uint8_t>(value >> 24);         // row if horizontal
-			assert(line2 != line3);
+			uint64_t cover = 0;
+			for(uint8_t i = 0; i < size; ++i)
+			{
+				bases[i] = candidateLines[indices[i]];
+				cover |= lines[bases[i]];
+			}
 			
-			auto removeCandidateAndPrint = [&](const uint8_t& line)
+			uint8_t seat = bitCount(cover);
+			if(!finned)
 			{
-				for(uint8_t i = 0; i < rank; ++i)
+				if(seat == size)
+					removeCandidateAndPrint(n, cover, 0, 0);
+			}
+			else if(size < seat && seat <= maxSeat)
+			{
+				// pick size lines out of the union as cover lines, the rest are fins.
+				for(uint64_t subset = cover; subset != 0; subset = (subset - 1) & cover)
 				{
-					if(i == line2 || i == line3)
-						continue;
-					
-					int32_t position = horizontal? (i * rank + line): (i + rank * line);
-					if(field[position] != INVALID_NUMBER)
+					if(bitCount(subset) != size)
 						continue;
 					
-					if(removeCandidate(position, number))
-						std::cout << GROUP_TEXT[horizontal ? ROW:COLUMN] << ' ' << int16_t(line2) << " and " << int16_t(line3)
-								<< " forms an X-wing about letter " << '\'' << toLetter(number) << '\'' << " in " 
-								<< GROUP_TEXT[horizontal ? COLUMN:ROW] << ' ' << int16_t(line0) << " and " << int16_t(line1)
-								<< ", remove candidate " << '\'' << toLetter(number) << '\''
-								<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
+					uint8_t block = getFinBlock(subset);
+					if(block != 0)
+						removeCandidateAndPrint(n, subset, block, cover & ~subset);
 				}
-			};
-			
-			removeCandidateAndPrint(line0);
-			removeCandidateAndPrint(line1);
+			}
 		}
+		while(nextCombination(indices, size, count));
 	}
 }
 
 void Sudoku::updateCandidateInOneLine(bool horizontal)
 {
-	// a blank group projects to one line.
-	auto project = [&](uint8_t blockIndex, uint8_t number, bool horizontal) -> uint16_t
-	{
-		const std::vector<int32_t>& positions = blankBlocks[blockIndex];
-		
-		uint8_t line1 = 0;
-		bool initialized = false;
-		for(const int32_t& position: positions)
-		{
-			const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-			if(std::find(candidates.begin(), candidates.end(), number) != candidates.end())
-			{
-				uint8_t line = horizontal? position / rank: position % rank;
-				if(initialized)
-				{
-					if(line1 != line)  // more than one line, fast fail.
-						return 0;
-				}
-				else
-				{
-					line1 = line;
-					initialized = true;
-				}
-			}
-		}
-		
-		if(!initialized)  // no line.
-			return 0;
-		
-		return (line1 << 8) | number;
-	};
-	
 	for(uint8_t b = 1; b <= rank; ++b)
 	for(uint8_t n = 1; n <= rank; ++n)
 	{
-		if(getMapPosition(b, n) >= 0)
+		if(isPlaced(getBlockUnit(b), n))
 			continue;
 		
-		const uint16_t& value = project(b, n, horizontal);
-		if(value != 0)
+		// a blank group projects to one line.
+		const uint64_t lines = projectBlock(b, n, horizontal);
+		if(bitCount(lines) == 1)
 		{
-			const uint8_t& line = reinterpret_cast<const uint8_t*>(&value)[1];
+			const uint8_t line = lowestBit(lines);
 			auto removeCandidateAndPrint = [&](const uint8_t& line)
 			{
 				for(uint8_t i = 0; i < rank; ++i)
@@ -1168,7 +1230,7 @@ void Sudoku::updateCandidateInOneLine(bool horizontal)
 					if(getNumber(position) != INVALID_NUMBER || blockIndices[position] == b)
 						continue;
 						
-					if(removeCandidate(position, n))
+					if(removeCandidate(position, n) && verbose)
 						std::cout << "blank block " << int32_t(b) << " all map to "
 								<< GROUP_TEXT[horizontal ? ROW:COLUMN] << ' ' << int32_t(line) << ','
 								<< " remove candidate " << '\'' << toLetter(n) << '\'' << " at position "
@@ -1188,56 +1250,19 @@ void Sudoku::updateCandidateInOneLine(bool horizontal)
  */
 void Sudoku::updateCandidateBetweenTwoLines(bool horizontal)
 {
-	auto project = [&](uint8_t blockIndex, uint8_t number, bool horizontal) -> uint32_t
-	{
-		const std::vector<int32_t>& positions = blankBlocks[blockIndex];
-		
-		constexpr uint8_t UNINITIALIZED = -1;
-		alignas(4) uint8_t lines[4] = {UNINITIALIZED, UNINITIALIZED, UNINITIALIZED, 0};
-		for(const int32_t& position: positions)
-		{
-			const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-			if(std::find(candidates.begin(), candidates.end(), number) != candidates.end())
-			{
-				const uint8_t& line = horizontal? position / rank: position % rank;
-				if(lines[1] == UNINITIALIZED)
-					lines[1] = line;
-				else if(lines[1] != line)
-				{
-					if(lines[2] == UNINITIALIZED)
-					{
-						lines[2] = line;
-						lines[0] = number;  // mark of two seats taken.
-					}
-					else if(lines[2] != line)
-						return 0;
-				}
-			}
-		}
-		
-		if(lines[0] == UNINITIALIZED)  // less than two seats.
-			return 0;
-		
-		// project() doesn't care about order of line numbers
-		if(lines[1] > lines[2])
-			std::swap(lines[1], lines[2]);
-		
-		return *reinterpret_cast<uint32_t*>(lines);
-	};
-	
 	for(uint8_t b1 = 1;      b1 <= rank; ++b1)
 	for(uint8_t b2 = b1 + 1; b2 <= rank; ++b2)
 	for(uint8_t n = 1;        n <= rank; ++n)
 	{
-		if(getMapPosition(b1, n) != INVALID_POSTION || getMapPosition(b2, n) != INVALID_POSTION)
+		if(isPlaced(getBlockUnit(b1), n) || isPlaced(getBlockUnit(b2), n))
 			continue;
 		
-		const int32_t& value1 = project(b1, n, horizontal);
-		const int32_t& value2 = project(b2, n, horizontal);
-		if(value1 != 0 && value1 == value2)
+		const uint64_t lines1 = projectBlock(b1, n, horizontal);
+		const uint64_t lines2 = projectBlock(b2, n, horizontal);
+		if(bitCount(lines1) == 2 && lines1 == lines2)
 		{
-			const uint8_t& line1 = reinterpret_cast<const uint8_t*>(&value1)[1];
-			const uint8_t& line2 = reinterpret_cast<const uint8_t*>(&value1)[2];
+			const uint8_t line1 = lowestBit(lines1);
+			const uint8_t line2 = lowestBit(lines1 & (lines1 - 1));
 			
 			auto removeCandidateAndPrint = [&](const uint8_t& line)
 			{
@@ -1249,7 +1274,7 @@ void Sudoku::updateCandidateBetweenTwoLines(bool horizontal)
 					if(getNumber(position) != 0 || blockIndices[position] == b1 || blockIndices[position] == b2)
 						continue;
 						
-					if(removeCandidate(position, n))
+					if(removeCandidate(position, n) && verbose)
 						std::cout << GROUP_TEXT[BLOCK] << ' ' << int16_t(b1) << " and " << int16_t(b2)
 								<< " map to two " << GROUP_TEXT[horizontal ? ROW:COLUMN]
 								<< " lines " << int16_t(line1) << " and " << int16_t(line2)
@@ -1266,81 +1291,39 @@ void Sudoku::updateCandidateBetweenTwoLines(bool horizontal)
 
 void Sudoku::updateCandidateAmongThreeLines(bool horizontal)
 {
-	auto project = [&](uint8_t blockIndex, uint8_t number, bool horizontal) -> uint32_t
+	for(uint8_t n = 1; n <= rank; ++n)
+	for(uint8_t b1 = 1; b1 <= rank; ++b1)
 	{
-		const std::vector<int32_t>& positions = blankBlocks[blockIndex];
+		if(isPlaced(getBlockUnit(b1), n))
+			continue;
 		
-		constexpr uint8_t UNINITIALIZED = -1;
-		alignas(4) uint8_t lines[4] = {number, UNINITIALIZED, UNINITIALIZED, UNINITIALIZED};
-		bool threeSeats = false;
-		for(const int32_t& position: positions)
+		const uint64_t lines1 = projectBlock(b1, n, horizontal);
+		if(bitCount(lines1) != 3)
+			continue;
+		
+		for(uint8_t b2 = b1 + 1; b2 <= rank; ++b2)
 		{
-			const std::vector<uint8_t>& candidates = blankCandidates.at(position);
-			if(std::find(candidates.begin(), candidates.end(), number) != candidates.end())
+			if(isPlaced(getBlockUnit(b2), n))
+				continue;
+			
+			if(projectBlock(b2, n, horizontal) != lines1)
+				continue;
+			
+			for(uint8_t b3 = b2 + 1; b3 <= rank; ++b3)
 			{
-				const uint8_t& line = horizontal? position / rank: position % rank;
-				if(lines[1] == UNINITIALIZED)
-					lines[1] = line;
-				else if(lines[1] != line)
+				if(isPlaced(getBlockUnit(b3), n))
+					continue;
+				
+				if(projectBlock(b3, n, horizontal) == lines1)
 				{
-					if(lines[2] == UNINITIALIZED)
-						lines[2] = line;
-					else if(lines[2] != line)
-					{
-						if(lines[3] == UNINITIALIZED)
-						{
-							lines[3] = line;
-							threeSeats = true;  // mark of two seats taken.
-						}
-						else if(lines[3] != line)
-							return 0;
-					}
-				}	
-			}
-		}
-		
-		if(!threeSeats)
-			return 0;
-		
-		// project() doesn't care about order of line numbers
-		if(lines[1] > lines[3])
-			std::swap(lines[1], lines[3]);
-		
-		if(lines[1] > lines[2])
-			std::swap(lines[1], lines[2]);
-		
-		if(lines[2] > lines[3])
-			std::swap(lines[2], lines[3]);
-		
-		return *reinterpret_cast<uint32_t*>(lines);
-	};
-	
-	for(uint8_t n = 1; n <= rank; ++n)
-	for(uint8_t b1 = 1; b1 <= rank; ++b1)
-	{
-		if(getMapPosition(b1, n) != INVALID_POSTION)
-			continue;
-		
-		const uint32_t& value1 = project(b1, n, horizontal);
-		for(uint8_t b2 = b1 + 1; b2 <= rank; ++b2)
-		{
-			if(getMapPosition(b2, n) != INVALID_POSTION)
-				continue;
-			
-			const uint32_t& value2 = project(b2, n, horizontal);
-			for(uint8_t b3 = b2 + 1; b3 <= rank; ++b3)
-			{
-				if(getMapPosition(b3, n) != INVALID_POSTION)
-					continue;
-				
-				const uint32_t& value3 = project(b3, n, horizontal);
-				if(value1 != 0 && value1 == value2 && value1 == value3)
-				{
-					const uint8_t& line1 = reinterpret_cast<const uint8_t*>(&value1)[1];
-					const uint8_t& line2 = reinterpret_cast<const uint8_t*>(&value1)[2];
-					const uint8_t& line3 = reinterpret_cast<const uint8_t*>(&value1)[3];
-					
-					auto removeCandidateAndPrint = [&](const uint8_t& line)
+					uint64_t mask = lines1;
+					const uint8_t line1 = lowestBit(mask);
+					mask &= mask - 1;
+					const uint8_t line2 = lowestBit(mask);
+					mask &= mask - 1;
+					const uint8_t line3 = lowestBit(mask);
+					
+					auto removeCandidateAndPrint = [&](const uint8_t& line)
 					{
 						for(uint8_t i = 0; i < rank; ++i)
 						{
@@ -1355,7 +1338,7 @@ void Sudoku::updateCandidateAmongThreeLines(bool horizontal)
 									|| blockIndices[position] == b3)
 								continue;
 								
-							if(removeCandidate(position, n))
+							if(removeCandidate(position, n) && verbose)
 								std::cout << GROUP_TEXT[BLOCK] << int16_t(b1) << int16_t(b2) << " and " << int16_t(b3)
 										<< " map to three " << GROUP_TEXT[horizontal ? ROW:COLUMN] << " lines " 
 										<< int16_t(line1) << ' ' << int16_t(line2) << " and " << int16_t(line3) << ','
@@ -1373,19 +1356,458 @@ void Sudoku::updateCandidateAmongThreeLines(bool horizontal)
 	}
 }
 
+/*
+ * Chains work on candidates instead of cells. If candidate A and B are strongly linked, A is false
+ * implies B is true; if B and C are weakly linked, B is true implies C is false. A chain alternating
+ * strong and weak links carries the implication from one end to the other end.
+ */
+struct Sudoku::LinkGraph
+{
+	std::vector<std::vector<int32_t>> strongLinks;  // indexed by candidate
+	std::vector<std::vector<int32_t>> weakLinks;    // ditto
+};
+
+bool Sudoku::hasCandidate(int32_t position, uint8_t number) const
+{
+	assert(0 <= position && position < rank * rank);
+	assert(0 < number && number <= rank);
+	return (candidates[position] >> (number - 1)) & 1;
+}
+
+bool Sudoku::isPeer(int32_t position0, int32_t position1) const
+{
+	assert(0 <= position0 && position0 < rank * rank);
+	assert(0 <= position1 && position1 < rank * rank);
+	if(position0 == position1)
+		return false;
+	
+	if(position0 / rank == position1 / rank
+			|| position0 % rank == position1 % rank
+			|| blockIndices[position0] == blockIndices[position1])
+		return true;
+	
+	const std::vector<int32_t>& units0 = cellUnits[position0];
+	const std::vector<int32_t>& units1 = cellUnits[position1];
+	for(size_t i = 3; i < units0.size(); ++i)  // extra units
+		if(std::find(units1.begin() + 3, units1.end(), units0[i]) != units1.end())
+			return true;
+	
+	return false;
+}
+
+void Sudoku::buildLinkGraph(LinkGraph& graph) const
+{
+	const int32_t candidateCount = rank * rank * rank;
+	graph.strongLinks.assign(candidateCount, std::vector<int32_t>());
+	graph.weakLinks.assign(candidateCount, std::vector<int32_t>());
+	
+	// link each pair of candidates, strongly if they are the only two.
+	auto link = [&graph](const int32_t* candidates, size_t size)
+	{
+		for(size_t i = 0; i < size; ++i)
+		for(size_t j = i + 1; j < size; ++j)
+		{
+			const int32_t& candidate0 = candidates[i];
+			const int32_t& candidate1 = candidates[j];
+			graph.weakLinks[candidate0].emplace_back(candidate1);
+			graph.weakLinks[candidate1].emplace_back(candidate0);
+			if(size == 2)
+			{
+				graph.strongLinks[candidate0].emplace_back(candidate1);
+				graph.strongLinks[candidate1].emplace_back(candidate0);
+			}
+		}
+	};
+	
+	std::vector<int32_t> candidates;
+	candidates.reserve(rank);
+	
+	// candidates in a cell
+	const int32_t rankSquared = rank * rank;
+	for(int32_t position = 0; position < rankSquared; ++position)
+	{
+		if(field[position] != INVALID_NUMBER)
+			continue;
+		
+		candidates.clear();
+		for(uint64_t mask = this->candidates[position]; mask != 0; mask &= mask - 1)
+			candidates.emplace_back(position * rank + lowestBit(mask));
+		link(candidates.data(), candidates.size());
+	}
+	
+	// seats of a number in a group
+	auto addSeat = [this, &candidates](int32_t position, uint8_t number)
+	{
+		if(hasCandidate(position, number))
+			candidates.emplace_back(position * rank + number - 1);
+	};
+	
+	for(uint8_t n = 1; n <= rank; ++n)
+	for(int32_t unit = 0; unit < unitCount; ++unit)
+	{
+		candidates.clear();
+		for(uint8_t i = 0; i < rank; ++i)
+			addSeat(units[unit * rank + i], n);
+		link(candidates.data(), candidates.size());
+	}
+	
+	// Two cells can share more than one group, like a row and a block, remove the duplicated links.
+	auto unique = [](std::vector<std::vector<int32_t>>& links)
+	{
+		for(std::vector<int32_t>& link: links)
+		{
+			std::sort(link.begin(), link.end());
+			link.erase(std::unique(link.begin(), link.end()), link.end());
+		}
+	};
+	
+	unique(graph.strongLinks);
+	unique(graph.weakLinks);
+}
+
+/*
+ * Take number N for example, if two cells are the only seats of N in a group, one and only one of
+ * them is N, so they can be painted in two colors. Starting from a cell, follow these conjugate 
+ * pairs and paint them alternately, all cells of a color are N, or all cells of the other color are.
+ * 1. Color wrap: if two cells of the same color see each other, they can't be both N, so cells of the 
+ *    other color are N, cross out N in cells of this color.
+ * 2. Color trap: a cell seeing both colors can't be N.
+ */
+void Sudoku::updateCandidateBySimpleColoring(const LinkGraph& graph, uint32_t budget)
+{
+	constexpr int32_t UNCOLORED = -1;
+	const int32_t rankSquared = rank * rank;
+	std::vector<int32_t> colors(rankSquared);  // chain index * 2 + color, indexed by position
+	std::vector<int32_t> chain;
+	
+	auto removeCandidateAndPrint = [this](int32_t position, uint8_t number, const char* reason)
+	{
+		if(removeCandidate(position, number) && verbose)
+			std::cout << "simple coloring on letter " << '\'' << toLetter(number) << '\''
+					<< ' ' << reason << ", remove candidate " << '\'' << toLetter(number) << '\''
+					<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
+	};
+	
+	// painted cells and peer checks are charged, the checks grow with the square of a chain.
+	auto spend = [&budget](uint32_t cost) -> bool
+	{
+		if(budget < cost)
+		{
+			budget = 0;
+			return false;
+		}
+		budget -= cost;
+		return true;
+	};
+	
+	for(uint8_t n = 1; n <= rank; ++n)
+	{
+		std::fill(colors.begin(), colors.end(), UNCOLORED);
+		int32_t chainIndex = 0;
+		for(int32_t start = 0; start < rankSquared; ++start)
+		{
+			if(colors[start] != UNCOLORED || !hasCandidate(start, n))
+				continue;
+			
+			// paint conjugate pairs breadth first.
+			const int32_t base = chainIndex * 2;
+			++chainIndex;
+			chain.clear();
+			chain.emplace_back(start);
+			colors[start] = base;
+			for(size_t i = 0; i < chain.size(); ++i)
+			{
+				const int32_t position = chain[i];
+				for(const int32_t& candidate: graph.strongLinks[position * rank + n - 1])
+				{
+					const int32_t other = candidate / rank;
+					if(other == position || colors[other] != UNCOLORED)  // skip bivalue link
+						continue;
+					if(!spend(1))
+						return;
+					
+					colors[other] = base + (base + 1 - colors[position]);
+					chain.emplace_back(other);
+				}
+			}
+			
+			if(chain.size() < 2)
+				continue;
+			
+			// color wrap
+			int32_t falseColor = UNCOLORED;
+			for(size_t i = 0; i < chain.size() && falseColor == UNCOLORED; ++i)
+			{
+				if(!spend(static_cast<uint32_t>(chain.size() - i - 1)))
+					return;
+				for(size_t j = i + 1; j < chain.size(); ++j)
+					if(colors[chain[i]] == colors[chain[j]] && isPeer(chain[i], chain[j]))
+					{
+						falseColor = colors[chain[i]];
+						break;
+					}
+			}
+			
+			if(falseColor != UNCOLORED)
+			{
+				for(const int32_t& position: chain)
+					if(colors[position] == falseColor)
+						removeCandidateAndPrint(position, n, "wraps");
+				continue;
+			}
+			
+			// color trap
+			for(int32_t position = 0; position < rankSquared; ++position)
+			{
+				if(colors[position] != UNCOLORED || !hasCandidate(position, n))
+					continue;
+				if(!spend(static_cast<uint32_t>(chain.size())))
+					return;
+				
+				bool seen[2] = {false, false};
+				for(const int32_t& colored: chain)
+					if(isPeer(position, colored))
+						seen[colors[colored] - base] = true;
+				
+				if(seen[0] && seen[1])
+					removeCandidateAndPrint(position, n, "traps");
+			}
+		}
+	}
+}
+
+/*
+ * Assume the first candidate of a chain is false, then the last candidate is true. In other words,
+ * at least one end of the chain is true. Let the two ends be N at cell P and M at cell Q,
+ * 1. N equals M, cells seeing both P and Q can cross out N.
+ * 2. P equals Q, the cell can cross out candidates other than N and M.
+ * 3. P and Q see each other, P can cross out M and Q can cross out N.
+ *
+ * Chains are searched breadth first, so the shortest one wins. A search state is a candidate being
+ * true or false. The link graph is built before eliminations, links of removed candidates remain in
+ * it, but it's fine because the implications still hold.
+ */
+void Sudoku::updateCandidateByChain(const LinkGraph& graph, bool bivalue, uint32_t budget)
+{
+	const int32_t stateCount = rank * rank * rank * 2;  // candidate * 2 + 1 if it's true
+	std::vector<uint32_t> marks(stateCount, 0);  // which search visited the state
+	std::vector<int32_t> parents(stateCount);
+	std::vector<int32_t> queue;
+	std::vector<int32_t> targets;
+	uint32_t mark = 0;
+	
+	auto isBivalue = [this](int32_t candidate) -> bool
+	{
+		return bitCount(candidates[candidate / rank]) == 2;
+	};
+	
+	auto print = [this](int32_t candidate) -> std::string
+	{
+		int32_t position = candidate / rank;
+		std::ostringstream os;
+		os << '(' << position / rank << ", " << position % rank << ')' << toLetter(candidate % rank + 1);
+		return os.str();
+	};
+	
+	auto printChain = [&](int32_t state)
+	{
+		std::vector<int32_t> states;
+		for(; state >= 0; state = parents[state])
+			states.emplace_back(state);
+		
+		std::cout << (bivalue? "XY-chain ": "alternating inference chain ");
+		for(size_t i = states.size(); i > 0; --i)
+		{
+			const int32_t& state = states[i - 1];
+			if(i != states.size())
+				std::cout << ((state & 1)? " = ": " - ");  // strong link to a true candidate
+			std::cout << print(state / 2);
+		}
+	};
+	
+	// collect candidates that conflict with both ends.
+	auto collectTargets = [this, &targets](int32_t first, int32_t last)
+	{
+		const int32_t position0 = first / rank, position1 = last / rank;
+		const uint8_t number0 = first % rank + 1, number1 = last % rank + 1;
+		
+		targets.clear();
+		if(position0 == position1)
+		{
+			const uint64_t ends = uint64_t(1) << (number0 - 1) | uint64_t(1) << (number1 - 1);
+			for(uint64_t mask = candidates[position0] & ~ends; mask != 0; mask &= mask - 1)
+				targets.emplace_back(position0 * rank + lowestBit(mask));
+		}
+		else if(number0 == number1)
+		{
+			const int32_t rankSquared = rank * rank;
+			for(int32_t position = 0; position < rankSquared; ++position)
+			{
+				if(hasCandidate(position, number0) && isPeer(position, position0) && isPeer(position, position1))
+					targets.emplace_back(position * rank + number0 - 1);
+			}
+		}
+		else if(isPeer(position0, position1))
+		{
+			if(hasCandidate(position0, number1))
+				targets.emplace_back(position0 * rank + number1 - 1);
+			if(hasCandidate(position1, number0))
+				targets.emplace_back(position1 * rank + number0 - 1);
+		}
+	};
+	
+	std::vector<int32_t> starts;
+	const int32_t rankSquared = rank * rank;
+	for(int32_t position = 0; position < rankSquared; ++position)
+	{
+		const uint64_t mask = candidates[position];
+		if(mask == 0 || (bivalue && bitCount(mask) != 2))
+			continue;
+		
+		for(uint64_t m = mask; m != 0; m &= m - 1)
+			starts.emplace_back(position * rank + lowestBit(m));
+	}
+	
+	for(const int32_t& start: starts)
+	{
+		if(!hasCandidate(start / rank, start % rank + 1))  // removed by previous chains
+			continue;
+		
+		++mark;
+		queue.clear();
+		queue.emplace_back(start * 2);
+		marks[start * 2] = mark;
+		parents[start * 2] = -1;
+		
+		for(size_t head = 0; head < queue.size(); ++head)
+		{
+			if(budget == 0)
+				return;
+			--budget;
+			
+			const int32_t state = queue[head];
+			const int32_t candidate = state / 2;
+			const bool on = state & 1;
+			if(on && candidate != start)
+			{
+				collectTargets(start, candidate);
+				bool printed = false;
+				for(const int32_t& target: targets)
+				{
+					if(!removeCandidate(target / rank, target % rank + 1) || !verbose)
+						continue;
+					
+					if(!printed)
+					{
+						printChain(state);
+						std::cout << '\n';
+						printed = true;
+					}
+					std::cout << "\tremove candidate " << '\'' << toLetter(target % rank + 1) << '\''
+							<< " at position " << '(' << target / rank / rank << ", " << target / rank % rank << ')' << '\n';
+				}
+			}
+			
+			const std::vector<int32_t>& links = on? graph.weakLinks[candidate]: graph.strongLinks[candidate];
+			for(const int32_t& next: links)
+			{
+				const bool sameCell = next / rank == candidate / rank;
+				// XY-chain links candidates strongly inside a cell and weakly between cells.
+				if(bivalue && (on == sameCell || !isBivalue(next)))
+					continue;
+				
+				const int32_t nextState = next * 2 + !on;
+				if(marks[nextState] == mark)
+					continue;
+				
+				marks[nextState] = mark;
+				parents[nextState] = state;
+				queue.emplace_back(nextState);
+			}
+		}
+	}
+}
+
+/*
+ * Locked candidates between any two units, if a number's candidates of unit A are all inside unit B,
+ * the number must be in the intersection, B can cross out the number outside A. Row, column and 
+ * block intersections are handled by the strategies above, this is for extra units.
+ */
+void Sudoku::updateCandidateByExtraUnit()
+{
+	const int32_t extraUnit = 3 * rank;  // the first extra unit
+	if(unitCount == extraUnit)
+		return;
+	
+	auto contains = [this](int32_t position, int32_t unit) -> bool
+	{
+		const std::vector<int32_t>& units = cellUnits[position];
+		return std::find(units.begin(), units.end(), unit) != units.end();
+	};
+	
+	int32_t seats[RANK_MAX];
+	for(int32_t unit = 0; unit < unitCount; ++unit)
+	for(uint8_t n = 1; n <= rank; ++n)
+	{
+		const int32_t* cells = &units[unit * rank];
+		uint8_t count = 0;
+		for(uint8_t i = 0; i < rank; ++i)
+			if(field[cells[i]] == INVALID_NUMBER && hasCandidate(cells[i], n))
+				seats[count++] = cells[i];
+		
+		if(count < 2)  // hidden single if only one
+			continue;
+		
+		for(const int32_t& other: cellUnits[seats[0]])
+		{
+			if(other == unit || (unit < extraUnit && other < extraUnit))
+				continue;
+			
+			bool locked = true;
+			for(uint8_t i = 1; i < count && locked; ++i)
+				locked = contains(seats[i], other);
+			if(!locked)
+				continue;
+			
+			const int32_t* otherCells = &units[other * rank];
+			for(uint8_t i = 0; i < rank; ++i)
+			{
+				const int32_t& position = otherCells[i];
+				if(field[position] != INVALID_NUMBER || contains(position, unit))
+					continue;
+				
+				if(removeCandidate(position, n) && verbose)
+					std::cout << getUnitText(unit) << " must feed letter " << '\'' << toLetter(n) << '\''
+							<< " in " << getUnitText(other) << ", so remove candidate " << '\'' << toLetter(n) << '\''
+							<< " at position " << '(' << position / rank << ", " << position % rank << ')' << '\n';
+			}
+		}
+	}
+}
+
 void Sudoku::update()
 {
 	// many a strategy has used here to remove candidates.
-	updateCandidateByNakedPair();
-	updateCandidateByNakedTriple();
+	updateCandidateByNakedSubset(2);
+	updateCandidateByNakedSubset(3);
 
 	constexpr bool horizontal = true;
 	constexpr bool vertical = false;
 
-	updateCandidateByXWing(horizontal);
-	updateCandidateByXWing(vertical);
+	for(uint8_t size = 2; size <= FISH_SIZE_MAX; ++size)
+	{
+		updateCandidateByFish(size, horizontal, false);
+		updateCandidateByFish(size, vertical,   false);
+	}
+	
+	for(uint8_t size = 2; size <= FISH_SIZE_MAX; ++size)
+	{
+		updateCandidateByFish(size, horizontal, true);
+		updateCandidateByFish(size, vertical,   true);
+	}
 	
 	updateCandidateOutBlockOfLine();
+	updateCandidateByExtraUnit();
 	
 	updateCandidateInBlockOutOfLine(horizontal);
 	updateCandidateInBlockOutOfLine(vertical);
@@ -1404,11 +1826,14 @@ void Sudoku::printCurrentState() const
 {
 	double combination = 1;
 	
-	for(const std::pair<int32_t, std::vector<uint8_t>>& blank: blankCandidates)
+	const int32_t rankSquared = rank * rank;
+	for(int32_t position = 0; position < rankSquared; ++position)
 	{
-		const int32_t& position = blank.first;
-		const std::vector<uint8_t> candidates = blank.second;
-		const int32_t size = static_cast<int32_t>(candidates.size());
+		if(field[position] != INVALID_NUMBER)
+			continue;
+		
+		const uint64_t mask = candidates[position];
+		const int32_t size = bitCount(mask);
 		
 		combination *= size; 
 		
@@ -1418,11 +1843,8 @@ void Sudoku::printCurrentState() const
 				<< '[' << std::setw(width) << position / rank << ']'
 				<< '[' << std::setw(width) << position % rank << ']'
 				<< " = " << '{';
-		const uint8_t last = static_cast<uint8_t>(size - 1);  // at most rank
-		for(uint8_t i = 0; i < last; ++i)
-			std::cout << toLetter(candidates[i]) << ", ";
-		if(last >= 0)
-			std::cout << toLetter(candidates[last]);
+		for(uint64_t m = mask; m != 0; m &= m - 1)  // a cell can have no candidate if the givens contradict.
+			std::cout << toLetter(lowestBit(m) + 1) << ((m & (m - 1))? ", ": "");
 		std::cout << '}' << '\n';
 	}
 	
@@ -1432,55 +1854,151 @@ void Sudoku::printCurrentState() const
 	{
 		int32_t count = 0;
 		for(uint8_t b = 1; b <= rank; ++b)
-			if(getMapPosition(b, n) >= 0)
+			if(isPlaced(getBlockUnit(b), n))
 				++count;
 		std::cout << "letter " << '\'' << toLetter(n) << '\''
 				<< " has shown " << count << " time(s) " << '\n';
 	}
 }
 
-void Sudoku::backtrack(int32_t position)
+Sudoku::Status Sudoku::checkBudget(const Budget& budget, bool clock)
 {
-	// looking for next blank cell
-	while(position < rank * rank && getNumber(position) != INVALID_NUMBER)
-		++position;
-	if(position >= rank * rank)  // full filled.
-		return;
+	++nodeCount;
+	if(budget.nodes != 0 && nodeCount > budget.nodes)
+		return STATUS_NODE_LIMIT;
+	
+	if(budget.cancel && budget.cancel->load(std::memory_order_relaxed))
+		return STATUS_CANCELLED;
+	
+	if(clock && std::chrono::steady_clock::now() >= budget.deadline)
+		return STATUS_DEADLINE;
+	
+	return STATUS_UNSOLVED;
+}
+
+struct Sudoku::SearchState
+{
+	std::vector<int32_t> positions;  // blank cells, [0, depth) are filled by guessing.
+	std::vector<uint64_t> unitMasks;  // bit (n - 1) is set if number n is in the unit.
+	std::vector<uint64_t> candidateMasks;  // candidates narrowed by logic, indexed by position.
+};
+
+uint64_t Sudoku::getChoiceMask(const SearchState& state, int32_t position) const
+{
+	uint64_t used = 0;
+	for(const int32_t& unit: cellUnits[position])
+		used |= state.unitMasks[unit];
+	return state.candidateMasks[position] & ~used;
+}
+
+/*
+ * Always guess the cell with the fewest choices, a cell without choice fails the branch at once.
+ * Used numbers of each unit are kept in bit masks, so a choice costs a few OR operations.
+ */
+Sudoku::Status Sudoku::search(SearchState& state, size_t depth, const Budget& budget)
+{
+	std::vector<int32_t>& positions = state.positions;
+	if(depth == positions.size())  // full filled.
+		return STATUS_SOLVED;
+	
+	size_t best = depth;
+	uint64_t bestChoices = 0;
+	uint8_t bestCount = RANK_MAX + 1;
+	for(size_t i = depth; i < positions.size() && bestCount > 1; ++i)
+	{
+		const uint64_t choices = getChoiceMask(state, positions[i]);
+		const uint8_t count = bitCount(choices);
+		if(count < bestCount)
+		{
+			best = i;
+			bestChoices = choices;
+			bestCount = count;
+		}
+	}
 	
-	for(uint8_t number = 1; number <= rank; ++number)
+	std::swap(positions[depth], positions[best]);
+	const int32_t position = positions[depth];
+	const std::vector<int32_t>& units = cellUnits[position];
+	for(uint64_t choices = bestChoices; choices != 0; choices &= choices - 1)
 	{
-		if(!isSafe(position, number))
+		Status status = checkBudget(budget, (nodeCount & CLOCK_INTERVAL_MASK) == 0);
+		if(status != STATUS_UNSOLVED)
+			return status;
+		
+		const uint8_t number = lowestBit(choices) + 1;
+		const uint64_t bit = uint64_t(1) << (number - 1);
+		for(const int32_t& unit: units)
+			state.unitMasks[unit] |= bit;
+		
+		status = search(state, depth + 1, budget);
+		for(const int32_t& unit: units)
+			state.unitMasks[unit] &= ~bit;
+		
+		if(status == STATUS_SOLVED)
+		{
+			field[position] = number;  // candidates are updated after all cells are filled.
+			return status;
+		}
+		
+		if(status != STATUS_NO_SOLUTION)  // budget runs out.
+			return status;
+	}
+	
+	return STATUS_NO_SOLUTION;
+}
+
+Sudoku::Status Sudoku::search(const Budget& budget)
+{
+	const int32_t positionCount = rank * rank;
+	SearchState state;
+	state.positions.reserve(blankCount);
+	state.unitMasks.assign(unitCount, 0);
+	state.candidateMasks.assign(positionCount, 0);
+	for(int32_t position = 0; position < positionCount; ++position)
+	{
+		const uint8_t& number = field[position];
+		if(number == INVALID_NUMBER)
+		{
+			state.positions.emplace_back(position);
+			state.candidateMasks[position] = getCandidateMask(position);
 			continue;
+		}
 		
-		field[position] = number;  // setNumber(position, number);
-		backtrack(position + 1);
-		field[position] = 0;  // setNumber(position, 0);
+		for(const int32_t& unit: cellUnits[position])
+			state.unitMasks[unit] |= uint64_t(1) << (number - 1);
 	}
+	
+	Status status = search(state, 0, budget);
+	if(status == STATUS_SOLVED)
+		for(const int32_t& position: state.positions)
+			updateNumber(position, field[position]);
+	
+	return status;
 }
 
-void Sudoku::backtrack()
+Sudoku::Status Sudoku::backtrack(const Budget& budget)
 {
-	backtrack(0);
+	nodeCount = 0;
+	return search(budget);
 }
 
-void Sudoku::solve()
+Sudoku::Status Sudoku::backtrack()
 {
-	if(blankCandidates.empty())
-	{
-		std::cout << "this sodoku is already solved\n";
-		return;
-	}
-	
-	auto printStep = [this](const std::vector<std::pair<int32_t, uint8_t>>& steps)
+	return backtrack(Budget());
+}
+
+void Sudoku::fill(const std::vector<std::pair<int32_t, uint8_t>>& steps)
+{
+	for(const std::pair<int32_t, uint8_t>& step: steps)
 	{
-		for(const std::pair<int32_t, uint8_t>& step: steps)
+		const int32_t& position = step.first;
+		const uint8_t& number = step.second;
+		
+		if(getNumber(position) != INVALID_NUMBER)
+			continue;
+		
+		if(verbose)
 		{
-			const int32_t& position = step.first;
-			const uint8_t& number = step.second;
-			
-			if(getNumber(position) != INVALID_NUMBER)
-				continue;
-			
 			int32_t row = position / rank;
 			int32_t column = position % rank;
 			int width = rank < 10 ? 1:2;
@@ -1488,80 +2006,249 @@ void Sudoku::solve()
 					<< '[' << std::setw(width) << row << ']'
 					<< '[' << std::setw(width) << column << ']'
 					<< " with " << '\'' << Sudoku::toLetter(number) << '\'' << '\n';
-			
-			setNumber(position, number);
 		}
-	};
-	
-	const auto& blankCandidates = this->blankCandidates;
-	auto countCandidate = [&blankCandidates]() -> int32_t
+		
+		setNumber(position, number);
+	}
+}
+
+int32_t Sudoku::countCandidate() const
+{
+	return candidateCount;
+}
+
+Sudoku::Status Sudoku::solve()
+{
+	return solve(Budget());
+}
+
+Sudoku::Status Sudoku::solve(const Budget& budget)
+{
+	nodeCount = 0;
+	if(blankCount == 0)
 	{
-		int32_t count = 0;
-		for(const std::pair<int32_t, std::vector<uint8_t>>& pair: blankCandidates)
-			count += static_cast<int32_t>(pair.second.size());  // candidates.size();
-		return count;
-	};
+		if(verbose)
+			std::cout << "this sodoku is already solved\n";
+		return STATUS_SOLVED;
+	}
 	
 	int32_t count = countCandidate();
 	while(true)
 	{
-		printCurrentState();
-		std::cout << '\n';
+		const Status status = checkBudget(budget, true);
+		if(status != STATUS_UNSOLVED)
+		{
+			if(verbose)
+				std::cout << "solving stops: " << STATUS_TEXT[status] << '\n';
+			return status;
+		}
+		
+		if(verbose)
+		{
+			printCurrentState();
+			std::cout << '\n';
+		}
 		
 		std::vector<std::pair<int32_t, uint8_t>> nakedSingleSteps = findNakedSingle();
 		if(!nakedSingleSteps.empty())
 		{
-			std::cout << "naked single move:" << '\n';
-			printStep(nakedSingleSteps);
+			if(verbose)
+				std::cout << "naked single move:" << '\n';
+			fill(nakedSingleSteps);
 		}
 		
 		std::vector<std::pair<int32_t, uint8_t>> hiddenSinglesteps = findHiddenSingle();
 		if(!hiddenSinglesteps.empty())
 		{
-			std::cout << "hidden single move:" << '\n';
-			printStep(hiddenSinglesteps);
+			if(verbose)
+				std::cout << "hidden single move:" << '\n';
+			fill(hiddenSinglesteps);
 		}
 
 		this->update();
-		std::cout<< toString() << '\n';
+		if(verbose)
+			std::cout << toString() << '\n';
 		
 		// We can't take stepsMoved == 0 for termination condition because a sudoku can 
 		// remove a cell's single candidate without moving a step during a cycle.
 		int32_t newCount = countCandidate();
+		if(newCount != 0 && newCount == count)
+		{
+			// chains are expensive, they are the last resort before giving up.
+			LinkGraph graph;
+			buildLinkGraph(graph);
+			updateCandidateBySimpleColoring(graph, CHAIN_BUDGET);
+			if(countCandidate() == count)
+				updateCandidateByChain(graph, true, CHAIN_BUDGET);
+			if(countCandidate() == count)
+				updateCandidateByChain(graph, false, CHAIN_BUDGET);
+			newCount = countCandidate();
+		}
+		
 		if(newCount != 0 && newCount < count)
 			count = newCount;
 		else
 			break;
 	}
 	
-	if(!blankCandidates.empty())
-		std::cout << "this sodoku is underdetermined" << '\n';
+	if(blankCount == 0)
+		return STATUS_SOLVED;
+	
+	if(!budget.guess)
+	{
+		if(verbose)
+			std::cout << "this sodoku is underdetermined" << '\n';
+		return STATUS_UNSOLVED;
+	}
+	
+	if(verbose)
+		std::cout << "logic gets stuck, try backtracking" << '\n';
+	const Status status = search(budget);
+	if(verbose)
+		std::cout << "backtracking stops: " << STATUS_TEXT[status] << '\n';
 //	printCurrentState();
+	return status;
 }
 
-std::string Sudoku::toString(bool lineByLine/* = true */) const
+bool Sudoku::apply(Technique technique)
 {
-	std::ostringstream os;
-#if 1
-	os << toLetter(getNumber(0));
-	int32_t last = rank * rank - 1;
-	for(int32_t i = 1; i < last; ++i)
-	{
-		os << toLetter(getNumber(i));
-		if(lineByLine && (i + 1) % rank == 0)
-			os << '\n';
+	constexpr bool horizontal = true;
+	constexpr bool vertical = false;
+	const int32_t count = countCandidate();
+	
+	switch(technique)
+	{
+	case TECHNIQUE_HIDDEN_SINGLE:
+		fill(findHiddenSingle());
+		break;
+	case TECHNIQUE_NAKED_SINGLE:
+		fill(findNakedSingle());
+		break;
+	case TECHNIQUE_LOCKED_CANDIDATE:
+		updateCandidateOutBlockOfLine();
+		updateCandidateInBlockOutOfLine(horizontal);
+		updateCandidateInBlockOutOfLine(vertical);
+		updateCandidateInOneLine(horizontal);
+		updateCandidateInOneLine(vertical);
+		updateCandidateByExtraUnit();
+		break;
+	case TECHNIQUE_NAKED_PAIR:
+		updateCandidateByNakedSubset(2);
+		break;
+	case TECHNIQUE_X_WING:
+		updateCandidateByFish(2, horizontal, false);
+		updateCandidateByFish(2, vertical,   false);
+		break;
+	case TECHNIQUE_MULTIPLE_LINES:
+		updateCandidateBetweenTwoLines(horizontal);
+		updateCandidateBetweenTwoLines(vertical);
+		updateCandidateAmongThreeLines(horizontal);
+		updateCandidateAmongThreeLines(vertical);
+		break;
+	case TECHNIQUE_NAKED_TRIPLE:
+		updateCandidateByNakedSubset(3);
+		break;
+	case TECHNIQUE_SWORDFISH:
+		updateCandidateByFish(3, horizontal, false);
+		updateCandidateByFish(3, vertical,   false);
+		break;
+	case TECHNIQUE_FINNED_FISH:
+		for(uint8_t size = 2; size <= FISH_SIZE_MAX; ++size)
+		{
+			updateCandidateByFish(size, horizontal, true);
+			updateCandidateByFish(size, vertical,   true);
+		}
+		break;
+	case TECHNIQUE_JELLYFISH:
+		updateCandidateByFish(4, horizontal, false);
+		updateCandidateByFish(4, vertical,   false);
+		break;
+	case TECHNIQUE_SIMPLE_COLORING:
+	case TECHNIQUE_XY_CHAIN:
+	case TECHNIQUE_AIC:
+	{
+		LinkGraph graph;
+		buildLinkGraph(graph);
+		if(technique == TECHNIQUE_SIMPLE_COLORING)
+			updateCandidateBySimpleColoring(graph, CHAIN_BUDGET);
+		else
+			updateCandidateByChain(graph, technique == TECHNIQUE_XY_CHAIN, CHAIN_BUDGET);
+		break;
 	}
-	if(last > 0)
-		os << toLetter(getNumber(last));
-#else
+	default:
+		assert(false);  // You should not be here.
+		break;
+	}
+	
+	return countCandidate() < count;
+}
+
+/*
+ * Like a human player, always take the easiest technique that helps, and start over from the easiest 
+ * one after each move. The puzzle is as hard as the hardest technique it needs, which is the way 
+ * Sudoku Explainer rates.
+ */
+Sudoku::Rating Sudoku::rate()
+{
+	Rating rating = {0.0F, TECHNIQUE_NONE, 0};
+	while(blankCount != 0)
+	{
+		uint8_t t = TECHNIQUE_HIDDEN_SINGLE;
+		for(; t < TECHNIQUE_BACKTRACK; ++t)
+			if(apply(static_cast<Technique>(t)))
+				break;
+		
+		const Technique technique = static_cast<Technique>(t);
+		if(technique > rating.hardest)
+		{
+			rating.hardest = technique;
+			rating.score = TECHNIQUE_SCORE[technique];
+		}
+		
+		if(technique == TECHNIQUE_BACKTRACK)  // logic fails, it needs guessing.
+			break;
+		
+		++rating.steps;
+	}
+	
+	return rating;
+}
+
+void Sudoku::setVerbose(bool verbose)
+{
+	this->verbose = verbose;
+}
+
+bool Sudoku::isVerbose() const
+{
+	return verbose;
+}
+
+int32_t Sudoku::getTextLength(bool lineByLine) const
+{
+	return rank * rank + (lineByLine? rank - 1: 0);
+}
+
+int32_t Sudoku::writeTo(char* buffer, bool lineByLine/* = false */) const
+{
+	assert(buffer);
+	char* p = buffer;
 	for(uint8_t r = 0; r < rank; ++r)
 	{
-		for(uint8_t c = 0; c < rank; ++c)
-			os << letter(getNumber(r, c));
+		if(lineByLine && r != 0)
+			*p++ = '\n';
 		
-		if(lineByLine && r != rank - 1)
-			os << '\n';
+		const uint8_t* row = field + r * rank;
+		for(uint8_t c = 0; c < rank; ++c)
+			*p++ = toLetter(row[c]);
 	}
-#endif
-	return os.str();
+	
+	return static_cast<int32_t>(p - buffer);
+}
+
+std::string Sudoku::toString(bool lineByLine/* = true */) const
+{
+	std::string text(getTextLength(lineByLine), '\0');
+	writeTo(&text[0], lineByLine);
+	return text;
 }
@@ -1,9 +1,12 @@
 #ifndef GITHUB_KALO2_SUDOKU_
 #define GITHUB_KALO2_SUDOKU_
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <map>
+#include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 /**
@@ -24,14 +27,84 @@
 class Sudoku
 {
 private:
+	/**
+	 * Masks of rank bits, stored as narrow as the rank allows: 16 bits up to rank 16, 32 bits up to
+	 * rank 32, 64 bits above. They are read and written as uint64_t.
+	 */
+	class MaskArray
+	{
+	private:
+		uint8_t* data;
+		uint8_t width;  // bytes per mask.
+		
+	public:
+		MaskArray(): data(nullptr), width(sizeof(uint64_t)) {}
+		
+		static uint8_t widthOf(uint8_t rank)
+		{
+			return rank <= 16? sizeof(uint16_t): rank <= 32? sizeof(uint32_t): sizeof(uint64_t);
+		}
+		
+		void assign(uint8_t* data, uint8_t width)
+		{
+			this->data = data;
+			this->width = width;
+		}
+		
+		uint64_t operator[](size_t i) const
+		{
+			switch(width)
+			{
+			case sizeof(uint16_t): return reinterpret_cast<const uint16_t*>(data)[i];
+			case sizeof(uint32_t): return reinterpret_cast<const uint32_t*>(data)[i];
+			default:               return reinterpret_cast<const uint64_t*>(data)[i];
+			}
+		}
+		
+		void set(size_t i, uint64_t mask)
+		{
+			switch(width)
+			{
+			case sizeof(uint16_t): reinterpret_cast<uint16_t*>(data)[i] = static_cast<uint16_t>(mask); break;
+			case sizeof(uint32_t): reinterpret_cast<uint32_t*>(data)[i] = static_cast<uint32_t>(mask); break;
+			default:               reinterpret_cast<uint64_t*>(data)[i] = mask;                        break;
+			}
+		}
+		
+		void add(size_t i, uint64_t bits)
+		{
+			set(i, (*this)[i] | bits);
+		}
+		
+		void remove(size_t i, uint64_t bits)
+		{
+			set(i, (*this)[i] & ~bits);
+		}
+	};
+	
 	const uint8_t rank;
 	const std::vector<uint8_t> initialState;
 	const std::vector<uint8_t> blockIndices;
 	
-	std::vector<uint8_t> field;  // it will be updated step by step, until all the cells are filled.
-	std::vector<int32_t> map;  // 2D array to store position, map[blockIndex][value] = position.
-	std::map<int32_t, std::vector<uint8_t>> blankCandidates;  // number candidates of blank cells.
-	std::vector<std::vector<int32_t>> blankBlocks;  // blank positions of blocks
+	int32_t unitCount;  // rows, columns, blocks and extra units.
+	std::vector<int32_t> units;  // 2D array to store position, units[unit][i] = position.
+	std::vector<std::vector<int32_t>> cellUnits;  // units of cells, row, column, block first, then extras.
+	std::vector<std::vector<uint8_t>> cellSeats;  // index of the cell in each of its units.
+	
+	// Solving state in structure-of-arrays layout. The arrays share one buffer, each array starts at
+	// a cache line, and the buffer takes whole cache lines, so sudokus of different threads never
+	// share a line. Masks are 16-bit for a 9x9 sudoku, its state takes 15 lines.
+	std::vector<uint64_t> storage;
+	MaskArray candidates;  // 1D array, bit (n - 1) of candidates[position] is set if n is a candidate.
+	MaskArray locations;  // 2D array, bit i of locations[unit][n - 1] is set if unit's i-th cell can be n.
+	MaskArray placedMasks;  // 1D array, bit (n - 1) of placedMasks[unit] is set if n is filled in the unit.
+	uint8_t* field;  // it will be updated step by step, until all the cells are filled.
+	uint8_t* remaining;  // 1D array, count of blank cells in a unit.
+	int32_t blankCount;
+	int32_t candidateCount;
+	
+	bool verbose;  // print the solving steps or not.
+	uint64_t nodeCount;  // nodes visited in current solving, for budget check.
 	
 private:
 	/**
@@ -54,27 +127,39 @@ private:
 	static std::vector<uint8_t> parse(const char* letters, int32_t length, char placeholder);
 	
 	/**
-	 * validate sudoku's initial state.
+	 * Check whether the group contains at most one value, group can be row, column or block.
 	 */
-	void validate(const std::vector<uint8_t>& state) const noexcept(false);
+	bool isGroupValid() const;
 	
 	/**
-	 * @return whether the block partition is valid or not.
+	 * Lay the state arrays out in one cache-line-aligned buffer.
 	 */
-	bool isBlockPartitionValid() const;
+	void allocate();
 	
 	/**
-	 * Check whether the group contains at most one value, group can be row, column or block.
+	 * @param blockIndex range [1, rank]
+	 * @return the unit of block @p blockIndex.
 	 */
-	bool isGroupValid() const;
+	int32_t getBlockUnit(uint8_t blockIndex) const;
 	
 	/**
-	 * @param blockIndex range [1, rank]
 	 * @param number range [1, rank]
-	 * @return valid range [0, rank * rank). If it is blank, return an invalid (nagative) value.
+	 * @return whether @p number is filled in @p unit.
+	 */
+	bool isPlaced(int32_t unit, uint8_t number) const;
+	
+	/**
+	 * Where can @p number go in @p unit, the view is updated along with cell candidates.
+	 * @return bit i is set if the i-th cell of @p unit has candidate @p number.
+	 */
+	uint64_t getLocationMask(int32_t unit, uint8_t number) const;
+	
+	/**
+	 * Project one number's candidates in a block to lines.
+	 * @param blockIndex range [1, rank]
+	 * @return bit i is set if row i (column i if not @p horizontal) has candidate @p number in the block.
 	 */
-	int32_t getMapPosition(uint8_t blockIndex, uint8_t number) const;
-	void    setMapPosition(uint8_t blockIndex, uint8_t number, int32_t position);
+	uint64_t projectBlock(uint8_t blockIndex, uint8_t number, bool horizontal) const;
 	
 	/**
 	 * @param position cell must be unfilled.
@@ -98,9 +183,17 @@ private:
 	std::vector<std::pair<int32_t, uint8_t>> findHiddenSingle() const;
 	
 	/**
-	 * A naked pair is two cells of identical candidates found in a particular group.
+	 * @return text like "row 0" or "block 1" of @p unit.
 	 */
-	void updateCandidateByNakedPair();
+	std::string getUnitText(int32_t unit) const;
+	
+	/**
+	 * A naked subset is @p size cells that have only @p size candidates in total, found in a
+	 * particular unit. A naked pair is two cells of identical candidates, a naked triple doesn't need
+	 * all of the three candidates in every cell.
+	 * @param size range [2, 3]
+	 */
+	void updateCandidateByNakedSubset(uint8_t size);
 	
 	/**
 	 * Hidden pairs are identified by the fact that a pair of numbers occur in only two cells of a 
@@ -110,17 +203,75 @@ private:
 	 */
 	void updateCandidateByHiddenPair();
 	
+	void updateCandidateOutBlockOfLine();
+	void updateCandidateInBlockOutOfLine(bool horizontal);
+	
 	/**
-	 * A naked triple is three cells of three candidates found in a particular group. Unlike naked 
-	 * pairs, naked triples don't need all of the three candidates in every cell. Quite often only 
-	 * two of the three candidates will be shown. 
+	 * Locked candidates between an extra unit and any other unit.
 	 */
-	void updateCandidateByNakedTriple();
+	void updateCandidateByExtraUnit();
 	
-	void updateCandidateOutBlockOfLine();
-	void updateCandidateInBlockOutOfLine(bool horizontal);
+	/**
+	 * Collect one number's candidates line by line.
+	 * @param number range [1, rank]
+	 * @param horizontal true to collect rows, false to collect columns.
+	 * @param[out] lines bit i of lines[j] is set if cell i of line j has candidate @p number. It
+	 *        has at least rank elements.
+	 */
+	void getLineMasks(uint8_t number, bool horizontal, uint64_t* lines) const;
+	
+	/**
+	 * Fish is the generalization of X-Wing. If @p size base lines hold a number's candidates in
+	 * @p size cover lines only, the cover lines can cross out the number outside the base lines.
+	 * X-Wing, swordfish and jellyfish are fish of size 2, 3 and 4.
+	 * A finned fish has extra candidates (fins) in the base lines. As long as the fins share one
+	 * block, cells of the cover lines in that block can cross out the number.
+	 * @param size range [2, 4]
+	 * @param horizontal true if base lines are rows, false if base lines are columns.
+	 * @param finned look for finned fish instead of basic fish.
+	 */
+	void updateCandidateByFish(uint8_t size, bool horizontal, bool finned);
 	
-	void updateCandidateByXWing(bool horizontal);
+	/**
+	 * Strong and weak links between candidates, a candidate is indexed with (position * rank +
+	 * number - 1). Defined in Sudoku.cpp.
+	 */
+	struct LinkGraph;
+	
+	/**
+	 * @return whether cell @p position has candidate @p number. The cell must be unfilled.
+	 */
+	bool hasCandidate(int32_t position, uint8_t number) const;
+	
+	/**
+	 * @return whether two different cells see each other, namely they share a row, column, block or
+	 *         extra unit.
+	 */
+	bool isPeer(int32_t position0, int32_t position1) const;
+	
+	/**
+	 * Two candidates are strongly linked if at least one of them is true, they are the only two
+	 * candidates of a cell, or the only two seats of a number in a group. Two candidates are weakly
+	 * linked if at most one of them is true, they are in the same cell, or they are the same number
+	 * and see each other.
+	 */
+	void buildLinkGraph(LinkGraph& graph) const;
+	
+	/**
+	 * Simple coloring colors each number's conjugate pairs alternately. If two cells of the same
+	 * color see each other, that color is false. Cells seeing both colors can't be the number.
+	 * @param budget At most so many cells are painted and peer pairs checked in this call.
+	 */
+	void updateCandidateBySimpleColoring(const LinkGraph& graph, uint32_t budget);
+	
+	/**
+	 * An alternating inference chain (AIC) alternates strong and weak links, it starts and ends with
+	 * strong links. One of the two ends must be true, candidates conflicting with both ends are false.
+	 * @param bivalue Only use bivalue cells, each strong link is inside a cell and each weak link is
+	 *        between cells, it's the XY-chain, XY-wing is the shortest XY-chain.
+	 * @param budget At most so many chain nodes are visited in this call.
+	 */
+	void updateCandidateByChain(const LinkGraph& graph, bool bivalue, uint32_t budget);
 	
 	void updateCandidateInOneLine      (bool horizontal);
 	void updateCandidateBetweenTwoLines(bool horizontal);
@@ -131,8 +282,6 @@ private:
 	 */
 	void updateNumber(int32_t position, uint8_t number);
 	
-	void backtrack(int32_t position);
-	
 	void printCurrentState() const;
 	
 public:
@@ -146,9 +295,96 @@ public:
 		ROW    = 1,
 		COLUMN = 2,
 		BLOCK  = 3,
+		EXTRA  = 4,  ///< extra unit of sudoku variants, like diagonals of X-Sudoku.
+	};
+	
+	static const char* GROUP_TEXT[5];  // = {"none", "row", "column", "block", "extra"}
+	
+	enum Error: uint8_t
+	{
+		ERROR_NONE            = 0,
+		ERROR_RANK            = 1,  ///< rank is out of range [1, RANK_MAX].
+		ERROR_LETTER          = 2,  ///< a letter is neither a number within rank nor a placeholder.
+		ERROR_BLOCK_PARTITION = 3,  ///< block index is out of range, or a block doesn't have rank cells.
+		ERROR_DUPLICATE       = 4,  ///< a number appears more than once in a group.
+		ERROR_UNIT            = 5,  ///< an extra unit doesn't have rank different cells.
 	};
 	
-	static const char* GROUP_TEXT[4];  // = {"none", "row", "column", "block"}
+	/**
+	 * What's wrong with the input. Fields irrelevant to the error are zero.
+	 */
+	struct Diagnostic
+	{
+		Error   error;
+		Group   group;   ///< the group where the error is found.
+		uint8_t index;   ///< group index, row, column and extra are zero-based, block is one-based.
+		uint8_t number;  ///< the duplicate number.
+		uint8_t row;     ///< the cell where the error is found.
+		uint8_t column;
+	};
+	
+	/**
+	 * @return human readable text of @p diagnostic.
+	 */
+	static std::string describe(const Diagnostic& diagnostic);
+	
+	/**
+	 * Solving techniques in the order of increasing difficulty.
+	 */
+	enum Technique: uint8_t
+	{
+		TECHNIQUE_NONE,  ///< the sudoku is already solved.
+		TECHNIQUE_HIDDEN_SINGLE,
+		TECHNIQUE_NAKED_SINGLE,
+		TECHNIQUE_LOCKED_CANDIDATE,  ///< a number's candidates of a block are in one line or vice versa.
+		TECHNIQUE_NAKED_PAIR,
+		TECHNIQUE_X_WING,
+		TECHNIQUE_MULTIPLE_LINES,  ///< a number's candidates of two or three blocks are in as many lines.
+		TECHNIQUE_NAKED_TRIPLE,
+		TECHNIQUE_SWORDFISH,
+		TECHNIQUE_FINNED_FISH,
+		TECHNIQUE_SIMPLE_COLORING,
+		TECHNIQUE_XY_CHAIN,
+		TECHNIQUE_JELLYFISH,
+		TECHNIQUE_AIC,
+		TECHNIQUE_BACKTRACK,  ///< logic fails, guessing is needed.
+		
+		TECHNIQUE_COUNT,
+	};
+	
+	static const char* TECHNIQUE_TEXT[TECHNIQUE_COUNT];
+	static const float TECHNIQUE_SCORE[TECHNIQUE_COUNT];
+	
+	struct Rating
+	{
+		float     score;    ///< score of the hardest technique.
+		Technique hardest;  ///< the hardest technique needed.
+		uint16_t  steps;    ///< count of moves, a move fills cells or removes candidates.
+	};
+	
+	enum Status: uint8_t
+	{
+		STATUS_SOLVED      = 0,
+		STATUS_UNSOLVED    = 1,  ///< logic gets stuck and guessing isn't allowed.
+		STATUS_NO_SOLUTION = 2,  ///< the givens contradict each other.
+		STATUS_NODE_LIMIT  = 3,  ///< the budget runs out, the grid is left partially solved.
+		STATUS_DEADLINE    = 4,
+		STATUS_CANCELLED   = 5,
+	};
+	
+	static const char* STATUS_TEXT[6];
+	
+	/**
+	 * Limits of one solving. They are checked between logic rounds and at each guess, so a solving
+	 * stops soon after a limit is hit, which bounds the worst case of adversarial input.
+	 */
+	struct Budget
+	{
+		uint64_t nodes = 0;  ///< logic rounds plus guesses, 0 for no limit.
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		const std::atomic<bool>* cancel = nullptr;  ///< other threads set it to true to stop the solving.
+		bool guess = true;  ///< fall back to backtracking when logic gets stuck.
+	};
 	
 	/**
 	 * map letter to number.
@@ -165,13 +401,102 @@ public:
 	 */
 	static char toLetter(uint8_t number);
 	
+private:
+	/**
+	 * Validate rank, letters, block partition and groups in a single pass over the grid, nothing 
+	 * is allocated and nothing is thrown.
+	 * @return ERROR_NONE if the input can construct a sudoku.
+	 */
+	static Diagnostic check(uint8_t rank, const char* states, const char* blocks, char placeholder,
+			const std::vector<std::vector<int32_t>>& extraUnits) noexcept;
+	
+	/**
+	 * @throw std::invalid_argument if @p diagnostic has an error.
+	 */
+	static const Diagnostic& throwIfInvalid(const Diagnostic& diagnostic) noexcept(false);
+	
+	/**
+	 * The input must have passed @fn check.
+	 */
+	Sudoku(uint8_t rank, const char* states, const char* blocks, char placeholder,
+			const std::vector<std::vector<int32_t>>& extraUnits, const Diagnostic& diagnostic);
+	
+	/**
+	 * Fill cells with the steps that single strategies find, cells already filled are skipped.
+	 */
+	void fill(const std::vector<std::pair<int32_t, uint8_t>>& steps);
+	
+	/**
+	 * @return total count of blank cells' candidates.
+	 */
+	int32_t countCandidate() const;
+	
+	/**
+	 * Apply @p technique once.
+	 * @return whether it fills any cell or removes any candidate.
+	 */
+	bool apply(Technique technique);
+	
+	/**
+	 * Count one node and check @p budget, the clock is read only if @p clock is true.
+	 * @return STATUS_UNSOLVED if the solving can go on, otherwise the limit that is hit.
+	 */
+	Status checkBudget(const Budget& budget, bool clock);
+	
+	/**
+	 * Search state of backtracking. Defined in Sudoku.cpp.
+	 */
+	struct SearchState;
+	
+	/**
+	 * @return bit (n - 1) is set if number n is a candidate of @p position and no unit of it has n.
+	 */
+	uint64_t getChoiceMask(const SearchState& state, int32_t position) const;
+	
+	/**
+	 * Guess blank cells of @p state from @p depth on, field is only changed if it's solved.
+	 */
+	Status search(SearchState& state, size_t depth, const Budget& budget);
+	Status search(const Budget& budget);
+	
 public:
 	/**
 	 * @param[in] rank sudoku's size.
 	 * @param[in] state cell values in row-major, 0 for unfilled cell.
 	 * @param[in] block cell partion, values are from 1 to @p rank.
+	 * @param[in] extraUnits units besides rows, columns and blocks, each has rank different positions,
+	 *            a number can appear at most once in each of them.
+	 */
+	Sudoku(uint8_t rank, const char* state, const char* block, char placeholder = '0',
+			const std::vector<std::vector<int32_t>>& extraUnits = {}) noexcept(false);
+	
+	Sudoku(const Sudoku&) = delete;  // state arrays point into the buffer.
+	Sudoku& operator=(const Sudoku&) = delete;
+	
+	/**
+	 * Exception-free version of the constructor, malformed input is quite common in batch solving.
+	 * @param[out] sudoku the created sudoku, or null if the input is invalid.
+	 * @param[out] diagnostic details about the error, it can be null.
+	 * @return ERROR_NONE on success.
+	 */
+	static Error tryCreate(std::unique_ptr<Sudoku>& sudoku, uint8_t rank, const char* state, const char* block,
+			char placeholder = '0', const std::vector<std::vector<int32_t>>& extraUnits = {},
+			Diagnostic* diagnostic = nullptr);
+	
+	/**
+	 * X-Sudoku, both main diagonals are units.
+	 */
+	static std::vector<std::vector<int32_t>> getDiagonalUnits(uint8_t rank);
+	
+	/**
+	 * Windoku, windows between regular blocks are units, @p rank must be a square number.
 	 */
-	Sudoku(uint8_t rank, const char* state, const char* block, char placeholder = '0') noexcept(false);
+	static std::vector<std::vector<int32_t>> getWindowUnits(uint8_t rank);
+	
+	/**
+	 * Disjoint groups, cells at the same place of each block form a unit. @p block must be valid.
+	 */
+	static std::vector<std::vector<int32_t>> getDisjointUnits(uint8_t rank, const char* block);
 	
 	uint8_t getRank() const;
 	
@@ -205,9 +530,9 @@ public:
 	bool isSafe(int32_t position, uint8_t number) const;
 	
 	/**
-	 * @return current blank cells' candidates.
+	 * @return bit (n - 1) is set if blank cell @p position has candidate n, filled cell has none.
 	 */
-	const std::map<int32_t, std::vector<uint8_t>>& getBlankCandidates() const;
+	uint64_t getCandidateMask(int32_t position) const;
 	
 	/**
 	 * update cells' candidate numbers.
@@ -215,11 +540,48 @@ public:
 	void update();
 	
 	/**
-	 * Find solution by backtracking algorithm, brute-force search can be time-consuming.
+	 * Find solution by backtracking algorithm, brute-force search can be time-consuming. It stops
+	 * at the first solution.
+	 * @return STATUS_SOLVED if a solution is found, the grid is unchanged otherwise.
+	 */
+	Status backtrack();
+	Status backtrack(const Budget& budget);
+	
+	/**
+	 * Solve by logic first, then guess if logic gets stuck and @p budget allows.
+	 * @return STATUS_SOLVED if all cells are filled, otherwise the grid is partially solved.
+	 */
+	Status solve();
+	Status solve(const Budget& budget);
+	
+	/**
+	 * Rate the difficulty by solving it with the easiest technique that makes progress at each move.
+	 * The sudoku is solved as far as logic goes when it returns. Sudoku objects share nothing, so a 
+	 * corpus can be rated on many threads.
+	 * @return difficulty, hardest technique is TECHNIQUE_BACKTRACK if logic can't solve it.
 	 */
-	void backtrack();
+	Rating rate();
 	
-	void solve();
+	/**
+	 * Solving steps are printed to standard output by default, turn it off for batch solving.
+	 */
+	void setVerbose(bool verbose);
+	bool isVerbose() const;
+	
+	/**
+	 * @param lineByLine whether rows are separated by line feeds.
+	 * @return count of characters that @fn writeTo(char* buffer, bool lineByLine) writes.
+	 */
+	int32_t getTextLength(bool lineByLine) const;
+	
+	/**
+	 * Write cell letters in row-major to @p buffer, no allocation happens here, and no terminating 
+	 * null character is appended.
+	 * @param[out] buffer It should have at least getTextLength(lineByLine) bytes.
+	 * @param lineByLine whether rows are separated by line feeds.
+	 * @return count of characters written.
+	 */
+	int32_t writeTo(char* buffer, bool lineByLine = false) const;
 	
 	std::string toString(bool lineByLine = true) const;
 
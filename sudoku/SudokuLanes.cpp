@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "SudokuLanes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SUDOKU_LANES_AVX2 1
+#include <immintrin.h>
+#else
+#define SUDOKU_LANES_AVX2 0
+#endif
+
+#if __cplusplus < 201703L  // static constexpr member variable declaration implies inline since C++17
+constexpr uint8_t SudokuLanes::RANK;
+constexpr int32_t SudokuLanes::CELL_COUNT;
+constexpr int32_t SudokuLanes::LANE_COUNT;
+#endif
+
+static constexpr uint16_t ALL_DIGITS = (1 << SudokuLanes::RANK) - 1;
+
+static inline uint8_t bitCount(uint16_t mask)
+{
+#if defined(__GNUC__)
+	return static_cast<uint8_t>(__builtin_popcount(mask));
+#else
+	uint8_t count = 0;
+	for(; mask != 0; mask &= mask - 1)
+		++count;
+	return count;
+#endif
+}
+
+/*
+ * One round of propagation over all units, every lane does the same work:
+ * 1. Naked single: a cell with one candidate removes it from the other cells of the unit.
+ * 2. Hidden single: a number with one seat in the unit is the only candidate of that cell.
+ * A lane fails if a number is placed twice or has no seat in a unit, or a cell has no candidate,
+ * or a cell is the only seat of two numbers.
+ *
+ * @return true if any cell of any lane changes.
+ */
+static bool reduce(uint16_t* cells, const uint8_t* units, int32_t unitCount, uint16_t* failures)
+{
+	constexpr int32_t LANE_COUNT = SudokuLanes::LANE_COUNT;
+	constexpr uint8_t RANK = SudokuLanes::RANK;
+	uint16_t changed = 0;
+	for(int32_t unit = 0; unit < unitCount; ++unit)
+	{
+		const uint8_t* positions = units + unit * RANK;
+		uint16_t placed[LANE_COUNT] = {}, conflicts[LANE_COUNT] = {};
+		uint16_t once[LANE_COUNT] = {}, twice[LANE_COUNT] = {};
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			const uint16_t* masks = cells + positions[i] * LANE_COUNT;
+			for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+			{
+				const uint16_t mask = masks[lane];
+				const uint16_t single = (mask & (mask - 1)) == 0? mask: 0;
+				conflicts[lane] |= placed[lane] & single;
+				placed[lane] |= single;
+			}
+		}
+		
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			uint16_t* masks = cells + positions[i] * LANE_COUNT;
+			for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+			{
+				uint16_t mask = masks[lane];
+				if((mask & (mask - 1)) != 0)
+					mask &= ~placed[lane];
+				changed |= mask ^ masks[lane];
+				masks[lane] = mask;
+				failures[lane] |= mask == 0;
+				twice[lane] |= once[lane] & mask;
+				once[lane] |= mask;
+			}
+		}
+		
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			uint16_t* masks = cells + positions[i] * LANE_COUNT;
+			for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+			{
+				const uint16_t mask = masks[lane];
+				const uint16_t hidden = mask & once[lane] & ~twice[lane];
+				if((mask & (mask - 1)) == 0 || hidden == 0)
+					continue;
+				
+				failures[lane] |= hidden & (hidden - 1);
+				changed |= mask ^ hidden;
+				masks[lane] = hidden;
+			}
+		}
+		
+		for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+			failures[lane] |= conflicts[lane] | (once[lane] ^ ALL_DIGITS);
+	}
+	
+	return changed != 0;
+}
+
+#if SUDOKU_LANES_AVX2
+/*
+ * @return all bits are set in lanes of at most one candidate.
+ */
+__attribute__((target("avx2")))
+static inline __m256i isSingle(__m256i mask)
+{
+	const __m256i difference = _mm256_sub_epi16(mask, _mm256_set1_epi16(1));
+	return _mm256_cmpeq_epi16(_mm256_and_si256(mask, difference), _mm256_setzero_si256());
+}
+
+/*
+ * Same as reduce(), a cell of all lanes is one register.
+ */
+__attribute__((target("avx2")))
+static bool reduceAvx2(uint16_t* cells, const uint8_t* units, int32_t unitCount, uint16_t* failures)
+{
+	constexpr uint8_t RANK = SudokuLanes::RANK;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i all = _mm256_set1_epi16(ALL_DIGITS);
+	__m256i* vectors = reinterpret_cast<__m256i*>(cells);
+	__m256i failed = _mm256_load_si256(reinterpret_cast<const __m256i*>(failures));
+	__m256i changed = zero;
+	
+	for(int32_t unit = 0; unit < unitCount; ++unit)
+	{
+		const uint8_t* positions = units + unit * RANK;
+		__m256i placed = zero, conflicts = zero, once = zero, twice = zero;
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			const __m256i mask = _mm256_load_si256(vectors + positions[i]);
+			const __m256i single = _mm256_and_si256(isSingle(mask), mask);
+			conflicts = _mm256_or_si256(conflicts, _mm256_and_si256(placed, single));
+			placed = _mm256_or_si256(placed, single);
+		}
+		
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			const __m256i mask = _mm256_load_si256(vectors + positions[i]);
+			const __m256i removed = _mm256_andnot_si256(isSingle(mask), placed);
+			const __m256i result = _mm256_andnot_si256(removed, mask);
+			changed = _mm256_or_si256(changed, _mm256_xor_si256(mask, result));
+			_mm256_store_si256(vectors + positions[i], result);
+			failed = _mm256_or_si256(failed, _mm256_cmpeq_epi16(result, zero));
+			twice = _mm256_or_si256(twice, _mm256_and_si256(once, result));
+			once = _mm256_or_si256(once, result);
+		}
+		
+		const __m256i exact = _mm256_andnot_si256(twice, once);
+		for(uint8_t i = 0; i < RANK; ++i)
+		{
+			const __m256i mask = _mm256_load_si256(vectors + positions[i]);
+			const __m256i hidden = _mm256_and_si256(mask, exact);
+			const __m256i taken = _mm256_andnot_si256(
+					_mm256_or_si256(isSingle(mask), _mm256_cmpeq_epi16(hidden, zero)), _mm256_cmpeq_epi16(zero, zero));
+			const __m256i result = _mm256_blendv_epi8(mask, hidden, taken);
+			failed = _mm256_or_si256(failed, _mm256_and_si256(taken, _mm256_andnot_si256(isSingle(hidden), hidden)));
+			changed = _mm256_or_si256(changed, _mm256_xor_si256(mask, result));
+			_mm256_store_si256(vectors + positions[i], result);
+		}
+		
+		failed = _mm256_or_si256(failed, _mm256_or_si256(conflicts, _mm256_xor_si256(once, all)));
+	}
+	
+	_mm256_store_si256(reinterpret_cast<__m256i*>(failures), failed);
+	return !_mm256_testz_si256(changed, changed);
+}
+#endif
+
+SudokuLanes::SudokuLanes(const char* block, char placeholder/* = '0'*/,
+		const std::vector<std::vector<int32_t>>& extraUnits/* = {} */) noexcept(false):
+		placeholder(placeholder),
+		vectorized(false)
+{
+	// let Sudoku check the block partition and extra units with an empty state.
+	const std::string state(CELL_COUNT, placeholder);
+	std::unique_ptr<Sudoku> sudoku;
+	Sudoku::Diagnostic diagnostic;
+	if(Sudoku::tryCreate(sudoku, RANK, state.c_str(), block, placeholder, extraUnits, &diagnostic) != Sudoku::ERROR_NONE)
+		throw std::invalid_argument(Sudoku::describe(diagnostic));
+	
+	// rows, columns, blocks, then extra units.
+	unitCount = 3 * RANK + static_cast<int32_t>(extraUnits.size());
+	units.resize(unitCount * RANK);
+	uint8_t blockSizes[1 + RANK] = {};
+	for(uint8_t position = 0; position < CELL_COUNT; ++position)
+	{
+		const uint8_t row = position / RANK, column = position % RANK;
+		const uint8_t blockIndex = Sudoku::toNumber(block[position]);
+		units[row * RANK + column] = position;
+		units[(RANK + column) * RANK + row] = position;
+		units[(2 * RANK + blockIndex - 1) * RANK + blockSizes[blockIndex]++] = position;
+	}
+	
+	for(size_t u = 0; u < extraUnits.size(); ++u)
+		std::copy(extraUnits[u].begin(), extraUnits[u].end(), units.begin() + (3 * RANK + u) * RANK);
+	
+	// cells and failures are read as 32-byte vectors, align them to cache line.
+	constexpr size_t LINE_SIZE = 64;
+	constexpr size_t WORDS_PER_LINE = LINE_SIZE / sizeof(uint16_t);
+	storage.assign((CELL_COUNT + 1) * LANE_COUNT + WORDS_PER_LINE, 0);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+	cells = reinterpret_cast<uint16_t*>((address + LINE_SIZE - 1) & ~uintptr_t(LINE_SIZE - 1));
+	failures = cells + CELL_COUNT * LANE_COUNT;
+	
+	for(Lane& lane: lanes)
+	{
+		lane.active = false;
+		lane.index = 0;
+	}
+
+#if SUDOKU_LANES_AVX2
+	vectorized = __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool SudokuLanes::isVectorized() const
+{
+	return vectorized;
+}
+
+bool SudokuLanes::load(int32_t lane, const char* state)
+{
+	assert(0 <= lane && lane < LANE_COUNT);
+	lanes[lane].stack.clear();
+	for(int32_t position = 0; position < CELL_COUNT; ++position)
+	{
+		const char& letter = state[position];
+		uint16_t mask;
+		if(letter == placeholder)
+			mask = ALL_DIGITS;
+		else if('1' <= letter && letter <= '9')
+			mask = 1 << (letter - '1');
+		else
+			return false;
+		
+		cells[position * LANE_COUNT + lane] = mask;
+	}
+	
+	return true;
+}
+
+void SudokuLanes::propagate()
+{
+	std::fill(failures, failures + LANE_COUNT, 0);
+#if SUDOKU_LANES_AVX2
+	if(vectorized)
+	{
+		while(reduceAvx2(cells, units.data(), unitCount, failures))
+			continue;
+		return;
+	}
+#endif
+	while(reduce(cells, units.data(), unitCount, failures))
+		continue;
+}
+
+Sudoku::Status SudokuLanes::step(int32_t lane)
+{
+	assert(0 <= lane && lane < LANE_COUNT);
+	std::vector<uint16_t>& stack = lanes[lane].stack;
+	if(failures[lane] != 0)
+	{
+		if(stack.empty())
+			return Sudoku::STATUS_NO_SOLUTION;
+		
+		// the last guess is wrong, go on with the rest of its candidates.
+		const uint16_t* snapshot = stack.data() + stack.size() - CELL_COUNT;
+		for(int32_t position = 0; position < CELL_COUNT; ++position)
+			cells[position * LANE_COUNT + lane] = snapshot[position];
+		stack.resize(stack.size() - CELL_COUNT);
+		return Sudoku::STATUS_UNSOLVED;
+	}
+	
+	// guess the cell with the fewest candidates.
+	int32_t choice = -1;
+	uint8_t fewest = RANK + 1;
+	for(int32_t position = 0; position < CELL_COUNT && fewest > 2; ++position)
+	{
+		const uint8_t count = bitCount(cells[position * LANE_COUNT + lane]);
+		if(count > 1 && count < fewest)
+		{
+			choice = position;
+			fewest = count;
+		}
+	}
+	
+	if(choice < 0)  // all cells are single, and no unit fails.
+		return Sudoku::STATUS_SOLVED;
+	
+	const size_t top = stack.size();
+	stack.resize(top + CELL_COUNT);
+	for(int32_t position = 0; position < CELL_COUNT; ++position)
+		stack[top + position] = cells[position * LANE_COUNT + lane];
+	
+	uint16_t& mask = cells[choice * LANE_COUNT + lane];
+	const uint16_t guess = mask & (~mask + 1);  // the lowest candidate
+	stack[top + choice] = mask & ~guess;
+	mask = guess;
+	return Sudoku::STATUS_UNSOLVED;
+}
+
+void SudokuLanes::solve(const char* const* states, size_t count, char* answers, Sudoku::Status* statuses)
+{
+	size_t next = 0;
+	int32_t activeCount = 0;
+	
+	// an idle lane has no candidate, it fails all the time but never changes.
+	auto fill = [&](int32_t lane)
+	{
+		Lane& current = lanes[lane];
+		current.active = false;
+		for(; next < count; ++next)
+		{
+			if(load(lane, states[next]))
+			{
+				current.active = true;
+				current.index = next++;
+				return;
+			}
+			statuses[next] = Sudoku::STATUS_UNSOLVED;
+		}
+		
+		for(int32_t position = 0; position < CELL_COUNT; ++position)
+			cells[position * LANE_COUNT + lane] = 0;
+	};
+	
+	for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+	{
+		fill(lane);
+		activeCount += lanes[lane].active;
+	}
+	
+	while(activeCount > 0)
+	{
+		propagate();
+		for(int32_t lane = 0; lane < LANE_COUNT; ++lane)
+		{
+			Lane& current = lanes[lane];
+			if(!current.active)
+				continue;
+			
+			const Sudoku::Status status = step(lane);
+			if(status == Sudoku::STATUS_UNSOLVED)
+				continue;
+			
+			statuses[current.index] = status;
+			if(status == Sudoku::STATUS_SOLVED)
+			{
+				char* answer = answers + current.index * CELL_COUNT;
+				for(int32_t position = 0; position < CELL_COUNT; ++position)
+					answer[position] = Sudoku::toLetter(bitCount(cells[position * LANE_COUNT + lane] - 1) + 1);
+			}
+			
+			fill(lane);
+			activeCount -= !current.active;
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef GITHUB_KALO2_SUDOKU_LANES_
+#define GITHUB_KALO2_SUDOKU_LANES_
+
+#include <cstdint>
+#include <vector>
+
+#include "Sudoku.h"
+
+/**
+ * A batch engine for 9x9 sudokus, it solves LANE_COUNT sudokus at once, one sudoku in each 16-bit
+ * lane of a SIMD register.
+ *
+ * Cell candidates are 9-bit masks stored lane by lane, so a cell of all the sudokus is one AVX2
+ * register. Naked singles and hidden singles are propagated in lockstep until no lane changes, then
+ * each lane is checked on its own: a solved sudoku leaves its lane and the next state takes the
+ * lane, a stuck sudoku guesses the cell with the fewest candidates, and a broken one backtracks.
+ *
+ * It's much faster than Sudoku for batch solving, but it only knows two techniques, and a sudoku
+ * with several solutions may get a different one. The AVX2 kernel is chosen when the CPU supports
+ * it, otherwise a portable kernel does the same work lane by lane.
+ */
+class SudokuLanes
+{
+public:
+	static constexpr uint8_t RANK = 9;
+	static constexpr int32_t CELL_COUNT = RANK * RANK;
+	static constexpr int32_t LANE_COUNT = 16;  ///< 16-bit masks in a 256-bit register.
+	
+private:
+	/**
+	 * A sudoku being solved in a lane.
+	 */
+	struct Lane
+	{
+		bool active;
+		size_t index;  // index of the state.
+		std::vector<uint16_t> stack;  // snapshots of the lane's cells, restored when a guess fails.
+	};
+	
+	const char placeholder;
+	int32_t unitCount;
+	std::vector<uint8_t> units;  // 2D array, units[unit][i] = position, rows, columns, blocks, then extras.
+	bool vectorized;  // the CPU supports AVX2.
+	
+	std::vector<uint16_t> storage;
+	uint16_t* cells;  // 2D array, cells[position][lane] is the candidate mask of a cell.
+	uint16_t* failures;  // 1D array, non-zero if the lane contradicts itself.
+	Lane lanes[LANE_COUNT];
+	
+private:
+	/**
+	 * Put @p state into @p lane.
+	 * @return false if @p state is malformed.
+	 */
+	bool load(int32_t lane, const char* state);
+	
+	/**
+	 * Propagate singles in all lanes until none of them changes.
+	 */
+	void propagate();
+	
+	/**
+	 * Guess or backtrack in @p lane after propagation.
+	 * @return STATUS_UNSOLVED if the lane goes on, otherwise the lane is done.
+	 */
+	Sudoku::Status step(int32_t lane);
+	
+public:
+	/**
+	 * @param[in] block cell partition like Sudoku, values are from 1 to 9.
+	 * @param[in] extraUnits units besides rows, columns and blocks.
+	 */
+	SudokuLanes(const char* block, char placeholder = '0',
+			const std::vector<std::vector<int32_t>>& extraUnits = {}) noexcept(false);
+	
+	SudokuLanes(const SudokuLanes&) = delete;  // cells point into the buffer.
+	SudokuLanes& operator=(const SudokuLanes&) = delete;
+	
+	/**
+	 * @return true if the AVX2 kernel is used.
+	 */
+	bool isVectorized() const;
+	
+	/**
+	 * Solve @p count states, a lane takes the next state as soon as its sudoku is done.
+	 * @param[in] states each has CELL_COUNT letters, unfilled cells are the placeholder.
+	 * @param[out] answers CELL_COUNT letters per state, only solved states are written.
+	 * @param[out] statuses STATUS_SOLVED, STATUS_NO_SOLUTION, or STATUS_UNSOLVED if a state is
+	 *             malformed. Only solved states are checked thoroughly, let Sudoku explain others.
+	 */
+	void solve(const char* const* states, size_t count, char* answers, Sudoku::Status* statuses);
+	
+};
+
+#endif  // GITHUB_KALO2_SUDOKU_LANES_
@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Sudoku.h"
+#include "SudokuServer.h"
+
+#if __cplusplus < 201703L  // static constexpr member variable declaration implies inline since C++17
+constexpr uint8_t SudokuServer::RECORD_MAGIC;
+#endif
+
+static constexpr size_t READ_SIZE = 64 * 1024;
+static constexpr int POLL_TIMEOUT = 200;  // milliseconds, how soon stop() is noticed.
+static constexpr uint32_t CONNECTION_LIMIT = 64;  // connections served at once, more are closed when accepted.
+static const char STATS_COMMAND[] = "stats";
+
+struct SudokuServer::Job
+{
+	bool binary;
+	bool stats;
+	uint32_t id;
+	std::string state;  // letters for text request, numbers for binary request.
+	Status status;
+	std::string answer;
+};
+
+struct SudokuServer::Batch
+{
+	std::vector<Job> jobs;
+	size_t remaining;
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+SudokuServer::SudokuServer(const Config& config):
+		config(config),
+		counters(),
+		running(false),
+		cancelled(false),
+		listenSocket(-1),
+		activeConnections(0)
+{
+	uint32_t threadCount = config.threadCount;
+	if(threadCount == 0)
+		threadCount = std::max(1U, std::thread::hardware_concurrency());
+	
+	running = true;
+	workers.reserve(threadCount);
+	for(uint32_t i = 0; i < threadCount; ++i)
+		workers.emplace_back(&SudokuServer::work, this);
+}
+
+SudokuServer::~SudokuServer()
+{
+	stop();
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queueCondition.notify_all();
+	}
+	
+	for(std::thread& worker: workers)
+		worker.join();
+	
+	if(listenSocket >= 0)
+	{
+		::close(listenSocket);
+		::unlink(config.path.c_str());
+	}
+}
+
+void SudokuServer::stop()
+{
+	running = false;
+	cancelled = true;
+}
+
+const SudokuServer::Counters& SudokuServer::getCounters() const
+{
+	return counters;
+}
+
+std::string SudokuServer::getCounterText() const
+{
+	std::ostringstream os;
+	os << "connections=" << counters.connections
+			<< " refused=" << counters.refused
+			<< " requests=" << counters.requests
+			<< " solved=" << counters.solved
+			<< " unsolved=" << counters.unsolved
+			<< " invalid=" << counters.invalid
+			<< " stopped=" << counters.stopped
+			<< " batches=" << counters.batches
+			<< " bytes_read=" << counters.bytesRead
+			<< " bytes_written=" << counters.bytesWritten
+			<< " solve_us=" << counters.solveMicroseconds;
+	return os.str();
+}
+
+void SudokuServer::work()
+{
+	while(true)
+	{
+		std::pair<Batch*, size_t> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			// the condition is also notified by the destructor, wake up periodically is not needed.
+			queueCondition.wait(lock, [this]() { return !queue.empty() || !running; });
+			if(queue.empty())
+				return;
+			
+			task = queue.front();
+			queue.pop_front();
+		}
+		
+		Batch& batch = *task.first;
+		solve(batch.jobs[task.second]);
+		
+		std::lock_guard<std::mutex> lock(batch.mutex);
+		if(--batch.remaining == 0)
+			batch.condition.notify_one();
+	}
+}
+
+void SudokuServer::solve(Job& job)
+{
+	const uint8_t& rank = config.rank;
+	const int32_t rankSquared = rank * rank;
+	auto start = std::chrono::steady_clock::now();
+	
+	// binary numbers are turned into letters, '0' is the placeholder then.
+	char placeholder = config.placeholder;
+	if(job.binary)
+	{
+		for(char& c: job.state)
+		{
+			const uint8_t number = static_cast<uint8_t>(c);
+			c = number <= rank? Sudoku::toLetter(number): '?';
+		}
+		placeholder = '0';
+	}
+	
+	std::unique_ptr<Sudoku> sudoku;
+	if(static_cast<int32_t>(job.state.size()) != rankSquared
+			|| Sudoku::tryCreate(sudoku, rank, job.state.c_str(), config.block.c_str(), placeholder,
+					config.extraUnits) != Sudoku::ERROR_NONE)
+	{
+		job.status = STATUS_INVALID;
+		if(job.binary)
+			job.answer.assign(rankSquared, '\0');
+		++counters.invalid;
+	}
+	else
+	{
+		Sudoku::Budget budget;
+		budget.nodes = config.nodeLimit;
+		if(config.timeLimit != 0)
+			budget.deadline = start + std::chrono::milliseconds(config.timeLimit);
+		budget.cancel = &cancelled;
+		
+		sudoku->setVerbose(false);
+		const Sudoku::Status status = sudoku->solve(budget);
+		
+		job.answer.resize(sudoku->getTextLength(false));
+		sudoku->writeTo(&job.answer[0]);
+		switch(status)
+		{
+		case Sudoku::STATUS_SOLVED:
+			job.status = STATUS_SOLVED;
+			++counters.solved;
+			break;
+		case Sudoku::STATUS_UNSOLVED:
+			job.status = STATUS_UNSOLVED;
+			++counters.unsolved;
+			break;
+		case Sudoku::STATUS_NO_SOLUTION:
+			job.status = STATUS_NO_SOLUTION;
+			++counters.unsolved;
+			break;
+		default:
+			job.status = STATUS_STOPPED;
+			++counters.stopped;
+			break;
+		}
+		if(job.binary)
+		{
+			for(char& c: job.answer)
+				c = static_cast<char>(Sudoku::toNumber(c));
+		}
+	}
+	
+	auto stop = std::chrono::steady_clock::now();
+	counters.solveMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+}
+
+void SudokuServer::parse(std::string& pending, bool& skipping, Batch& batch)
+{
+	const size_t rankSquared = config.rank * config.rank;
+	const size_t recordSize = 1 + sizeof(uint32_t) + rankSquared;
+	const size_t lineLimit = std::max(rankSquared, sizeof(STATS_COMMAND) - 1) + 1;  // with CR but not LF.
+	size_t offset = 0;
+	while(offset < pending.size())
+	{
+		Job job = {};
+		if(skipping)
+		{
+			const size_t end = pending.find('\n', offset);
+			skipping = end == std::string::npos;
+			offset = skipping? pending.size(): end + 1;
+			continue;
+		}
+		
+		if(static_cast<uint8_t>(pending[offset]) == RECORD_MAGIC)
+		{
+			if(pending.size() - offset < recordSize)
+				break;
+			
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pending.data() + offset + 1);
+			job.binary = true;
+			job.id = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+			job.state.assign(pending, offset + 1 + sizeof(uint32_t), rankSquared);
+			offset += recordSize;
+		}
+		else
+		{
+			const size_t end = pending.find('\n', offset);
+			if((end == std::string::npos? pending.size(): end) - offset > lineLimit)
+			{
+				// too long for a state, it's answered as an invalid one and dropped up to its newline.
+				skipping = end == std::string::npos;
+				offset = skipping? pending.size(): end + 1;
+				batch.jobs.emplace_back(std::move(job));
+				continue;
+			}
+			if(end == std::string::npos)
+				break;
+			
+			job.state.assign(pending, offset, end - offset);
+			if(!job.state.empty() && job.state.back() == '\r')
+				job.state.pop_back();
+			offset = end + 1;
+			
+			job.stats = job.state == STATS_COMMAND;
+			if(job.stats)
+				job.answer = getCounterText();
+		}
+		
+		batch.jobs.emplace_back(std::move(job));
+	}
+	
+	pending.erase(0, offset);
+}
+
+void SudokuServer::dispatch(Batch& batch)
+{
+	// stats jobs are answered when parsed, set the count before any worker can finish a job.
+	batch.remaining = 0;
+	for(const Job& job: batch.jobs)
+		if(!job.stats)
+			++batch.remaining;
+	if(batch.remaining == 0)
+		return;
+	
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		for(size_t i = 0; i < batch.jobs.size(); ++i)
+			if(!batch.jobs[i].stats)
+				queue.emplace_back(&batch, i);
+	}
+	queueCondition.notify_all();
+	
+	std::unique_lock<std::mutex> lock(batch.mutex);
+	batch.condition.wait(lock, [&batch]() { return batch.remaining == 0; });
+}
+
+void SudokuServer::serve(int socket)
+{
+	std::string pending;  // a partial request, parse() keeps it shorter than a record or a line.
+	bool skipping = false;  // the rest of an overlong line is dropped.
+	std::string output;
+	std::vector<char> buffer(READ_SIZE);
+	
+	bool open = true;
+	while(open && running)
+	{
+		pollfd descriptor = {socket, POLLIN, 0};
+		int ready = ::poll(&descriptor, 1, POLL_TIMEOUT);
+		if(ready < 0 && errno != EINTR)
+			break;
+		if(ready <= 0)
+			continue;
+		
+		ssize_t size = ::recv(socket, buffer.data(), buffer.size(), 0);
+		if(size <= 0)
+		{
+			if(size < 0 && errno == EINTR)
+				continue;
+			break;  // the client closes the connection.
+		}
+		counters.bytesRead += size;
+		pending.append(buffer.data(), size);
+		
+		Batch batch;
+		parse(pending, skipping, batch);
+		if(batch.jobs.empty())
+			continue;
+		
+		dispatch(batch);
+		counters.requests += batch.jobs.size();
+		++counters.batches;
+		
+		output.clear();
+		for(const Job& job: batch.jobs)
+		{
+			if(job.binary)
+			{
+				output.push_back(static_cast<char>(RECORD_MAGIC));
+				for(int i = 0; i < 32; i += 8)
+					output.push_back(static_cast<char>(job.id >> i));
+				output.push_back(static_cast<char>(job.status));
+				output.append(job.answer);
+			}
+			else
+			{
+				// an invalid state has an empty answer line, like the batch mode.
+				if(job.stats || job.status != STATUS_INVALID)
+					output.append(job.answer);
+				output.push_back('\n');
+			}
+		}
+		
+		for(size_t offset = 0; offset < output.size(); )
+		{
+			ssize_t written = ::send(socket, output.data() + offset, output.size() - offset, MSG_NOSIGNAL);
+			if(written < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				open = false;
+				break;
+			}
+			offset += written;
+			counters.bytesWritten += written;
+		}
+	}
+	
+	::close(socket);
+}
+
+int SudokuServer::run()
+{
+	const size_t rankSquared = config.rank * config.rank;
+	if(config.block.size() != rankSquared)
+	{
+		std::cerr << "invalid block length: " << config.block.size() << ", needs " << rankSquared << '\n';
+		return -1;
+	}
+	
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(config.path.size() >= sizeof(address.sun_path))
+	{
+		std::cerr << "socket path is too long: " << config.path << '\n';
+		return -1;
+	}
+	std::strcpy(address.sun_path, config.path.c_str());
+	
+	listenSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenSocket < 0)
+	{
+		std::cerr << "socket: " << std::strerror(errno) << '\n';
+		return -1;
+	}
+	
+	::unlink(config.path.c_str());
+	if(::bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+			|| ::listen(listenSocket, SOMAXCONN) != 0)
+	{
+		std::cerr << "bind " << config.path << ": " << std::strerror(errno) << '\n';
+		return -1;
+	}
+	
+	std::cout << "serving on " << config.path << " with " << workers.size() << " threads" << std::endl;
+	while(running)
+	{
+		pollfd descriptor = {listenSocket, POLLIN, 0};
+		int ready = ::poll(&descriptor, 1, POLL_TIMEOUT);
+		if(ready <= 0)
+			continue;
+		
+		int socket = ::accept(listenSocket, nullptr, nullptr);
+		if(socket < 0)
+			continue;
+		
+		{
+			std::lock_guard<std::mutex> lock(connectionMutex);
+			if(activeConnections >= CONNECTION_LIMIT)
+			{
+				::close(socket);
+				++counters.refused;
+				continue;
+			}
+			++activeConnections;
+		}
+		++counters.connections;
+		
+		std::thread([this, socket]()
+		{
+			serve(socket);
+			std::lock_guard<std::mutex> lock(connectionMutex);
+			if(--activeConnections == 0)
+				connectionCondition.notify_all();
+		}).detach();
+	}
+	
+	// connections notice the stop within POLL_TIMEOUT, wait for them before workers are gone.
+	std::unique_lock<std::mutex> lock(connectionMutex);
+	connectionCondition.wait(lock, [this]() { return activeConnections == 0; });
+	std::cout << getCounterText() << std::endl;
+	return 0;
+}
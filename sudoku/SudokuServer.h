@@ -0,0 +1,130 @@
+#ifndef GITHUB_KALO2_SUDOKU_SERVER_
+#define GITHUB_KALO2_SUDOKU_SERVER_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A solver daemon listening on a Unix domain socket, it saves the process start-up cost per puzzle.
+ *
+ * Rank, block partition, placeholder and extra units are fixed when the server starts. A client
+ * can pipeline requests of two formats on one connection, and responses are sent in request order:
+ * - text: a state line like the batch mode of SudokuSolver, the answer line is returned, or an
+ *   empty line if the state is invalid. The line "stats" returns the counters. A line longer than
+ *   a state is invalid, and the rest of it is dropped.
+ * - binary: byte RECORD_MAGIC, uint32 id in little-endian, then rank * rank cell numbers, 0 for
+ *   blank cells. The response is RECORD_MAGIC, the id, a Status byte and rank * rank numbers.
+ *
+ * Requests that arrive in one read are solved as a batch on a fixed thread pool, and their responses
+ * are written with one call. A connection is closed when it's accepted if too many are open.
+ */
+class SudokuServer
+{
+public:
+	static constexpr uint8_t RECORD_MAGIC = 0xB5;  // never a text letter.
+	
+	enum Status: uint8_t
+	{
+		STATUS_SOLVED      = 0,
+		STATUS_UNSOLVED    = 1,  ///< reserved, solving always falls back to guessing.
+		STATUS_INVALID     = 2,  ///< the input can't construct a sudoku.
+		STATUS_NO_SOLUTION = 3,
+		STATUS_STOPPED     = 4,  ///< the budget runs out or the server stops, the partial grid is returned.
+	};
+	
+	struct Config
+	{
+		std::string path;  ///< socket path, it is replaced if it exists.
+		uint8_t rank;
+		std::string block;  ///< block partition, rank * rank letters.
+		char placeholder;
+		std::vector<std::vector<int32_t>> extraUnits;
+		uint32_t threadCount;  ///< 0 for the hardware concurrency.
+		uint64_t nodeLimit;  ///< logic rounds and guesses per puzzle, 0 for no limit.
+		uint32_t timeLimit;  ///< milliseconds per puzzle, 0 for no limit.
+	};
+	
+	/**
+	 * Counters are updated while serving, they can be read any time.
+	 */
+	struct Counters
+	{
+		std::atomic<uint64_t> connections;  ///< accepted connections.
+		std::atomic<uint64_t> refused;  ///< connections closed because too many are open.
+		std::atomic<uint64_t> requests;
+		std::atomic<uint64_t> solved;
+		std::atomic<uint64_t> unsolved;  ///< including puzzles without solution.
+		std::atomic<uint64_t> invalid;
+		std::atomic<uint64_t> stopped;  ///< puzzles that run out of budget.
+		std::atomic<uint64_t> batches;
+		std::atomic<uint64_t> bytesRead;
+		std::atomic<uint64_t> bytesWritten;
+		std::atomic<uint64_t> solveMicroseconds;  ///< total time spent by workers.
+	};
+	
+private:
+	struct Job;
+	struct Batch;
+	
+	const Config config;
+	Counters counters;
+	
+	std::atomic<bool> running;
+	std::atomic<bool> cancelled;  // solvings in progress give up when the server stops.
+	int listenSocket;
+	
+	std::vector<std::thread> workers;
+	std::deque<std::pair<Batch*, size_t>> queue;  // (batch, job index) to solve.
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	
+	uint32_t activeConnections;
+	std::mutex connectionMutex;
+	std::condition_variable connectionCondition;
+	
+private:
+	void work();
+	void solve(Job& job);
+	void serve(int socket);
+	
+	/**
+	 * Parse complete requests at the front of @p pending into @p batch, they are removed from @p pending.
+	 * A text line longer than a state is an invalid request, @p skipping is set until its newline.
+	 */
+	void parse(std::string& pending, bool& skipping, Batch& batch);
+	
+	/**
+	 * Solve jobs of @p batch on the thread pool, and wait until all of them are done.
+	 */
+	void dispatch(Batch& batch);
+	
+public:
+	SudokuServer(const Config& config);
+	~SudokuServer();
+	
+	SudokuServer(const SudokuServer&) = delete;
+	SudokuServer& operator=(const SudokuServer&) = delete;
+	
+	/**
+	 * Listen and serve until @fn stop() is called.
+	 * @return 0 on normal exit, otherwise the socket setup fails.
+	 */
+	int run();
+	
+	/**
+	 * Ask @fn run() to return, it's async-signal-safe.
+	 */
+	void stop();
+	
+	const Counters& getCounters() const;
+	std::string getCounterText() const;
+
+};
+
+#endif  // GITHUB_KALO2_SUDOKU_SERVER_
@@ -1,15 +1,24 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <chrono>
 #include <ctime>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 
 #include "Sudoku.h"
+#include "SudokuLanes.h"
+#if SUDOKU_SERVER
+#include <csignal>
+#include "SudokuServer.h"
+#endif
 
 /*
 	Use this command to compile, your compiler needs to support C++11 syntax:
-		gcc Sudoku.cpp SudokuSolver.cpp -o sudoku -O3 -Wall -lstdc++
+		gcc Sudoku.cpp SudokuLanes.cpp SudokuSolver.cpp -o sudoku -O3 -Wall -lstdc++
 	
 	Here are some useful links for further reading.
 	http://en.wikipedia.org/wiki/Exact_cover_problem
@@ -18,9 +27,23 @@
 	https://github.com/dimitri/sudoku
 */
 
-// 0: input data comes from commandline. use it in release mode.
-// 1: some sudoku examples, input data hard coded in program. use it in debug mode.
+// 1: input data comes from commandline. use it in release mode.
+// 0: some sudoku examples, input data hard coded in program. use it in debug mode.
+#ifndef COMMANDLINE_INPUT
 #define COMMANDLINE_INPUT 0
+#endif
+
+/*
+ * The deadline is counted from now, so call it right before solving.
+ */
+static Sudoku::Budget getBudget(uint64_t nodeLimit, uint32_t timeLimit)
+{
+	Sudoku::Budget budget;
+	budget.nodes = nodeLimit;
+	if(timeLimit != 0)
+		budget.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeLimit);
+	return budget;
+}
 
 #if COMMANDLINE_INPUT
 
@@ -28,21 +51,60 @@ static void usage()
 {
 	const char* PROGRAM = "sudoku";
 	
-	std::cout << "Usage: " << PROGRAM << " rank state [block] [placeholder]" << R"(
+	std::cout << "Usage: " << PROGRAM << " [-r] [-l] [-x] [-w] [-g] [-n nodes] [-d ms] rank state [block] [placeholder]" << '\n';
+#if SUDOKU_SERVER
+	std::cout << "       " << PROGRAM << " [-x] [-w] [-g] [-n nodes] [-d ms] -s socket [-t threads] rank [block] [placeholder]" << '\n';
+#endif
+	std::cout << R"(
+  -r         : Rate the difficulty instead of solving, it prints the score and the hardest technique.
+  -l         : Solve 9x9 states from standard input 16 at a time in SIMD lanes, it's much faster. A
+               sudoku with several solutions may get a different one. It can't go with -r, -n or -d.
+  -x         : X-Sudoku, numbers can't repeat on both main diagonals.
+  -w         : Windoku, numbers can't repeat in the windows between regular blocks.
+  -g         : Disjoint groups, numbers can't repeat in cells at the same place of each block.
+  -n nodes   : Give up a sudoku after so many logic rounds and guesses, the partial grid is printed.
+  -d ms      : Give up a sudoku after so many milliseconds, the partial grid is printed.
   rank       : The sudoku's size, usually it's 9.
   state      : Initial state, row-major matrix, ranges from 1 to rank, unfilled cell will be 0 if no placeholder is set.
+               Use - to solve states from standard input, one state per line, one answer per line.
   block      : Sudoku's block partition, row-major matrix, ranges from 1 to rank. It's optional for regular 3x3 sudoku.
   placeholder: Unfilled cell's character like *, space, or 0. It's optional for 0 character.
 )";
+#if SUDOKU_SERVER
+	std::cout << R"(  -s socket  : Serve as a daemon on the Unix domain socket, see SudokuServer.h for the protocol.
+  -t threads : Solver threads of the daemon, it's the hardware concurrency by default.
+)";
+#endif
 }
 
+#if SUDOKU_SERVER
+static SudokuServer* server = nullptr;
+
+static void handleSignal(int)
+{
+	if(server)
+		server->stop();
+}
+
+static int serve(const SudokuServer::Config& config)
+{
+	SudokuServer daemon(config);
+	server = &daemon;
+	std::signal(SIGINT, handleSignal);
+	std::signal(SIGTERM, handleSignal);
+	int result = daemon.run();
+	server = nullptr;
+	return result;
+}
+#endif
+
 /*
  * std::sqrt takes a float value as input, output a float value. and libm must linked to the final
  * program. That's why we need an integer version of square root.
  *
  * @see https://en.wikipedia.org/wiki/Methods_of_computing_square_roots#Binary_numeral_system_(base_2)
  */
-static constexpr uint32_t sqrt_i(uint32_t n)
+static uint32_t sqrt_i(uint32_t n)  // constexpr function with loops needs C++14
 {
 	uint32_t res = 0U;
 	uint32_t bit = 1U << 30;
@@ -66,9 +128,203 @@ static constexpr uint32_t sqrt_i(uint32_t n)
 	return res;
 }
 
+/*
+ * Solve (or rate) states line by line from standard input. Answers are appended to a large buffer,
+ * which is written out with one call when it's full, so output costs no allocation per sudoku.
+ *
+ * With @p lanes, 9x9 states are read in chunks and solved by SudokuLanes first, states it doesn't
+ * solve are handed over to Sudoku, so errors are reported the same way.
+ */
+static int solveBatch(uint8_t rank, const char* block, char placeholder,
+		const std::vector<std::vector<int32_t>>& extraUnits, uint64_t nodeLimit, uint32_t timeLimit, bool rating,
+		bool lanes)
+{
+	const size_t rankSquared = rank * rank;
+	constexpr size_t RATING_LENGTH_MAX = 64;
+	const size_t lineLength = std::max(rankSquared, RATING_LENGTH_MAX) + 1;
+	constexpr size_t BUFFER_SIZE = 1 << 20;
+	std::vector<char> buffer(std::max(BUFFER_SIZE, lineLength));
+	size_t size = 0;
+	
+	auto flush = [&buffer, &size]()
+	{
+		std::fwrite(buffer.data(), 1, size, stdout);
+		size = 0;
+	};
+	
+	std::unique_ptr<Sudoku> sudoku;
+	auto solveLine = [&](const std::string& line, int32_t lineNumber)
+	{
+		if(size + lineLength > buffer.size())
+			flush();
+		
+		// An invalid state has an empty answer line, so answers still match states line by line.
+		// Malformed input is common here, they are reported without throwing exceptions.
+		if(line.size() != rankSquared)
+			std::cerr << "line " << lineNumber << ": invalid state length: " << line.size() << ", needs " << rankSquared << '\n';
+		else
+		{
+			Sudoku::Diagnostic diagnostic;
+			if(Sudoku::tryCreate(sudoku, rank, line.c_str(), block, placeholder, extraUnits, &diagnostic) != Sudoku::ERROR_NONE)
+				std::cerr << "line " << lineNumber << ": " << Sudoku::describe(diagnostic) << '\n';
+			else if(rating)
+			{
+				sudoku->setVerbose(false);
+				Sudoku::Rating rating = sudoku->rate();
+				size += std::snprintf(buffer.data() + size, RATING_LENGTH_MAX, "%.1f %s",
+						rating.score, Sudoku::TECHNIQUE_TEXT[rating.hardest]);
+			}
+			else
+			{
+				sudoku->setVerbose(false);
+				Sudoku::Status status = sudoku->solve(getBudget(nodeLimit, timeLimit));
+				if(status != Sudoku::STATUS_SOLVED)
+					std::cerr << "line " << lineNumber << ": " << Sudoku::STATUS_TEXT[status] << '\n';
+				size += sudoku->writeTo(buffer.data() + size);
+			}
+		}
+		
+		buffer[size++] = '\n';
+	};
+	
+	std::ios::sync_with_stdio(false);
+	std::string line;
+	int32_t lineNumber = 0;
+	if(!lanes)
+	{
+		while(std::getline(std::cin, line))
+		{
+			if(!line.empty() && line.back() == '\r')
+				line.pop_back();
+			solveLine(line, ++lineNumber);
+		}
+	}
+	else
+	{
+		std::unique_ptr<SudokuLanes> engine;
+		try
+		{
+			engine.reset(new SudokuLanes(block, placeholder, extraUnits));
+		}
+		catch(const std::invalid_argument& e)
+		{
+			std::cerr << e.what() << '\n';
+			return -2;
+		}
+		
+		constexpr size_t CHUNK_SIZE = 4096;  // states, lanes are refilled within a chunk.
+		std::vector<std::string> lines(CHUNK_SIZE);
+		std::vector<const char*> states;
+		std::vector<size_t> indices;
+		std::vector<char> answers(CHUNK_SIZE * rankSquared);
+		std::vector<Sudoku::Status> statuses(CHUNK_SIZE);
+		bool end = false;
+		while(!end)
+		{
+			size_t count = 0;
+			for(; count < CHUNK_SIZE; ++count)
+			{
+				if(!std::getline(std::cin, lines[count]))
+				{
+					end = true;
+					break;
+				}
+				if(!lines[count].empty() && lines[count].back() == '\r')
+					lines[count].pop_back();
+			}
+			
+			states.clear();
+			indices.clear();
+			for(size_t i = 0; i < count; ++i)
+				if(lines[i].size() == rankSquared)
+				{
+					states.emplace_back(lines[i].c_str());
+					indices.emplace_back(i);
+				}
+			engine->solve(states.data(), states.size(), answers.data(), statuses.data());
+			
+			for(size_t i = 0, j = 0; i < count; ++i)
+			{
+				++lineNumber;
+				if(j < indices.size() && indices[j] == i && statuses[j] == Sudoku::STATUS_SOLVED)
+				{
+					if(size + lineLength > buffer.size())
+						flush();
+					std::memcpy(buffer.data() + size, answers.data() + j * rankSquared, rankSquared);
+					size += rankSquared;
+					buffer[size++] = '\n';
+				}
+				else
+					solveLine(lines[i], lineNumber);
+				
+				if(j < indices.size() && indices[j] == i)
+					++j;
+			}
+		}
+	}
+	
+	flush();
+	std::fflush(stdout);
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
-	if(argc < 3)
+	bool rating = false, lanes = false, diagonal = false, window = false, disjoint = false;
+	uint64_t nodeLimit = 0;
+	uint32_t timeLimit = 0;
+	const char* socketPath = nullptr;
+#if SUDOKU_SERVER
+	uint32_t threadCount = 0;
+#endif
+	for(; argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0'; --argc, ++argv)  // "-" is a state
+	{
+		if(std::strcmp(argv[1], "-r") == 0)
+			rating = true;
+		else if(std::strcmp(argv[1], "-l") == 0)
+			lanes = true;
+#if SUDOKU_SERVER
+		else if(std::strcmp(argv[1], "-s") == 0 && argc > 2)
+		{
+			socketPath = argv[2];
+			--argc;
+			++argv;
+		}
+		else if(std::strcmp(argv[1], "-t") == 0 && argc > 2)
+		{
+			threadCount = std::stoi(argv[2]);
+			--argc;
+			++argv;
+		}
+#endif
+		else if(std::strcmp(argv[1], "-n") == 0 && argc > 2)
+		{
+			nodeLimit = std::stoull(argv[2]);
+			--argc;
+			++argv;
+		}
+		else if(std::strcmp(argv[1], "-d") == 0 && argc > 2)
+		{
+			timeLimit = std::stoul(argv[2]);
+			--argc;
+			++argv;
+		}
+		else if(std::strcmp(argv[1], "-x") == 0)
+			diagonal = true;
+		else if(std::strcmp(argv[1], "-w") == 0)
+			window = true;
+		else if(std::strcmp(argv[1], "-g") == 0)
+			disjoint = true;
+		else
+		{
+			std::cerr << "unknown option: " << argv[1] << '\n';
+			return -1;
+		}
+	}
+	
+	// the daemon reads states from its clients, there's no state argument.
+	const int32_t blockArgument = socketPath? 2: 3;
+	if(argc < blockArgument)
 	{
 		usage();
 		return 0;
@@ -81,21 +337,22 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 	
-	const char* state = argv[2];
+	const char* state = socketPath? "-": argv[2];
+	const bool batch = std::strcmp(state, "-") == 0;
 	size_t stateLength = std::strlen(state);
 	const int32_t rankSquared = rank * rank;
-	if(stateLength != rankSquared)
+	if(!batch && stateLength != rankSquared)
 	{
 		std::cerr << "invalid state length: " << stateLength << ", needs " << rankSquared << '\n';
 		return -2;
 	}
 	const char* block;
-	char placeholder = argc > 5 ? argv[5][0] : '0';
+	char placeholder = argc > blockArgument + 1 ? argv[blockArgument + 1][0] : '0';
 	
 	std::vector<char> blockPartition;
-	if(argc > 4)
+	if(argc > blockArgument)
 	{
-		block = argv[3];
+		block = argv[blockArgument];
 		size_t blockLength = std::strlen(block);
 		if(blockLength != rankSquared)
 		{
@@ -123,6 +380,44 @@ int main(int argc, char* argv[])
 		block = blockPartition.data();
 	}
 	
+	std::vector<std::vector<int32_t>> extraUnits;
+	auto append = [&extraUnits](const std::vector<std::vector<int32_t>>& units)
+	{
+		extraUnits.insert(extraUnits.end(), units.begin(), units.end());
+	};
+	
+	if(diagonal)
+		append(Sudoku::getDiagonalUnits(rank));
+	if(window)
+	{
+		if(sqrt_i(rank) * sqrt_i(rank) != static_cast<uint32_t>(rank))
+		{
+			std::cerr << "windoku needs a square rank" << '\n';
+			return -3;
+		}
+		append(Sudoku::getWindowUnits(rank));
+	}
+	if(disjoint)
+		append(Sudoku::getDisjointUnits(rank, block));
+	
+#if SUDOKU_SERVER
+	if(socketPath)
+	{
+		SudokuServer::Config config = {socketPath, static_cast<uint8_t>(rank), std::string(block, rankSquared),
+				placeholder, extraUnits, threadCount, nodeLimit, timeLimit};
+		return serve(config);
+	}
+#endif
+	
+	if(lanes && (rank != SudokuLanes::RANK || rating || nodeLimit != 0 || timeLimit != 0))
+	{
+		std::cerr << "lanes only solve 9x9 sudokus without -r, -n or -d" << '\n';
+		return -3;
+	}
+	
+	if(batch)
+		return solveBatch(rank, block, placeholder, extraUnits, nodeLimit, timeLimit, rating, lanes);
+	
 #else
 
 int main()
@@ -194,20 +489,34 @@ int main()
 		"aaabbbccccddd";
 */
 	constexpr char placeholder = '0';
+	constexpr bool rating = false;
+	const std::vector<std::vector<int32_t>> extraUnits;
+	constexpr uint64_t nodeLimit = 0;
+	constexpr uint32_t timeLimit = 0;
 
 #endif
 
 	try
 	{
-		Sudoku sudoku(rank, state, block, placeholder);
+		Sudoku sudoku(rank, state, block, placeholder, extraUnits);
 		std::cout << "initial state:" << '\n'
 				<< sudoku.toString() << '\n';
 		
 		std::time_t start = std::clock();
-		sudoku.solve();  // sudoku.backtrack(); is not recommended since it's time-consuming.
+		Sudoku::Rating difficulty = {};
+		Sudoku::Status status = Sudoku::STATUS_SOLVED;
+		if(rating)
+			difficulty = sudoku.rate();
+		else
+			status = sudoku.solve(getBudget(nodeLimit, timeLimit));  // sudoku.backtrack(); is not recommended since it's time-consuming.
 		std::time_t stop = std::clock();
 		double elapsedTime = static_cast<double>(stop - start) / CLOCKS_PER_SEC;
 		std::cout << "solver uses " << elapsedTime << 's' << '\n';
+		if(!rating)
+			std::cout << "status: " << Sudoku::STATUS_TEXT[status] << '\n';
+		if(rating)
+			std::cout << "difficulty: " << difficulty.score
+					<< " (" << Sudoku::TECHNIQUE_TEXT[difficulty.hardest] << ')' << '\n';
 		
 		std::cout << "final state:" << '\n'
 				<< sudoku.toString() << '\n';